@@ -0,0 +1,330 @@
+// Throughput of packing and unpacking typical payloads. Build with -DMSGPACK_BUILD_BENCHMARKS=ON in Release mode:
+//
+//   Msgpack_bench [--filter <text>] [--min-time <seconds>] [--json <file>]
+//
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <new>
+#include <set>
+#include <string>
+#include <thread>
+
+#include <msgpack/msgpack.hpp>
+#include <msgpack/parallel.hpp>
+
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+// GCC can't tell that the replacement operators below pair malloc with free
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+// Every allocation in the process goes through here so each benchmark can report allocations per operation
+static std::atomic<uint64_t> allocations{0};
+
+void *operator new(std::size_t size) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  if (auto memory = std::malloc(size == 0 ? 1 : size)) {
+    return memory;
+  }
+  throw std::bad_alloc{};
+}
+
+void operator delete(void *memory) noexcept {
+  std::free(memory);
+}
+
+void operator delete(void *memory, std::size_t /*size*/) noexcept {
+  std::free(memory);
+}
+
+namespace {
+// Stops the compiler from optimizing away work whose result is never read
+template<class T>
+void keep(T &value) {
+#if defined(__GNUC__) || defined(__clang__)
+  asm volatile("" : : "r"(&value) : "memory");
+#else
+  static const void *volatile sink;
+  sink = &value;
+#endif
+}
+
+struct Result {
+  std::string name;
+  std::string operation;
+  uint64_t iterations;
+  std::size_t bytes_per_op;
+  double ns_per_op;
+  double mb_per_s;
+  double allocs_per_op;
+};
+
+struct Options {
+  std::string filter{};
+  double min_time = 0.2;
+  std::string json_path{};
+};
+
+class Suite {
+ public:
+  explicit Suite(Options options) : options(std::move(options)) {};
+
+  // Runs operation often enough to fill the minimum time and records its cost, bytes_per_op being the packed size
+  void run(const std::string &name, const std::string &operation, std::size_t bytes_per_op,
+           const std::function<void()> &body) {
+    if (!options.filter.empty() && (name + "/" + operation).find(options.filter) == std::string::npos) {
+      return;
+    }
+    body(); // Warm up caches and let buffers reach their final size
+    for (auto iterations = uint64_t{1};; iterations *= 2) {
+      auto allocations_before = allocations.load(std::memory_order_relaxed);
+      auto start = std::chrono::steady_clock::now();
+      for (auto i = uint64_t{0}; i < iterations; ++i) {
+        body();
+      }
+      auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      if (elapsed >= options.min_time || iterations >= (uint64_t{1} << 40)) {
+        auto allocated = allocations.load(std::memory_order_relaxed) - allocations_before;
+        auto ns_per_op = elapsed * 1e9 / double(iterations);
+        record(Result{name, operation, iterations, bytes_per_op, ns_per_op, double(bytes_per_op) * 1e3 / ns_per_op,
+                      double(allocated) / double(iterations)});
+        return;
+      }
+    }
+  }
+
+  void write_json() const {
+    if (options.json_path.empty()) {
+      return;
+    }
+    auto out = std::ofstream{options.json_path};
+    out << "{\n  \"library\": \"cppack\",\n  \"version\": \"" << MSGPACK_BENCH_VERSION << "\",\n"
+        << "  \"hardware_threads\": " << std::thread::hardware_concurrency() << ",\n  \"results\": [";
+    for (auto i = std::size_t{0}; i < results.size(); ++i) {
+      auto &result = results[i];
+      out << (i == 0 ? "\n" : ",\n") << "    {\"name\": \"" << result.name << "\", \"operation\": \""
+          << result.operation << "\", \"iterations\": " << result.iterations << ", \"bytes_per_op\": "
+          << result.bytes_per_op << ", \"ns_per_op\": " << result.ns_per_op << ", \"mb_per_s\": " << result.mb_per_s
+          << ", \"allocs_per_op\": " << result.allocs_per_op << "}";
+    }
+    out << "\n  ]\n}\n";
+  }
+
+ private:
+  Options options;
+  std::vector<Result> results{};
+
+  void record(Result result) {
+    if (results.empty()) {
+      std::printf("%-40s %-10s %14s %12s %12s\n", "benchmark", "op", "ns/op", "MB/s", "allocs/op");
+    }
+    std::printf("%-40s %-10s %14.1f %12.1f %12.2f\n", result.name.c_str(), result.operation.c_str(), result.ns_per_op,
+                result.mb_per_s, result.allocs_per_op);
+    std::fflush(stdout);
+    results.push_back(std::move(result));
+  }
+};
+
+// Top level messages have to be objects, so single values get wrapped
+template<class T>
+struct Single {
+  T value;
+
+  template<class Packer>
+  void pack(Packer &pack) {
+    pack(value);
+  }
+};
+
+struct Person {
+  std::string name;
+  uint16_t age;
+  std::vector<std::string> aliases;
+
+  template<class T>
+  void pack(T &pack) {
+    pack(name, age, aliases);
+  }
+};
+
+struct Team {
+  std::string title;
+  std::vector<Person> members;
+  std::map<std::string, double> ratings;
+
+  template<class T>
+  void pack(T &pack) {
+    pack(title, members, ratings);
+  }
+};
+
+Person make_person(std::size_t index) {
+  return Person{"Person number " + std::to_string(index), uint16_t(20 + index % 60),
+                {"Alias " + std::to_string(index), "Nickname"}};
+}
+
+// Packs obj into a reused packer, then unpacks it into a fresh object: checked, unchecked, and unchecked after
+// validate<T>() as a buffer from an untrusted source would be
+template<class T>
+void pack_and_unpack(Suite &suite, const std::string &name, T obj) {
+  auto packer = msgpack::Packer{};
+  packer.pack_object(obj);
+  auto data = packer.vector();
+  suite.run(name, "pack", data.size(), [&] {
+    packer.clear();
+    packer.pack_object(obj);
+    keep(packer);
+  });
+  suite.run(name, "unpack", data.size(), [&] {
+    auto unpacked = T{};
+    auto unpacker = msgpack::Unpacker{data.data(), data.size()};
+    unpacker.unpack_object(unpacked);
+    keep(unpacked);
+  });
+  suite.run(name, "unchecked", data.size(), [&] {
+    auto unpacked = T{};
+    auto unpacker = msgpack::UncheckedUnpacker{data.data(), data.size()};
+    unpacker.unpack_object(unpacked);
+    keep(unpacked);
+  });
+  suite.run(name, "validated", data.size(), [&] {
+    auto unpacked = T{};
+    if (!msgpack::validate<T>(data)) {
+      auto unpacker = msgpack::UncheckedUnpacker{data.data(), data.size()};
+      unpacker.unpack_object(unpacked);
+    }
+    keep(unpacked);
+  });
+}
+
+template<class T>
+void scalar(Suite &suite, const std::string &type, T value) {
+  pack_and_unpack(suite, "scalar/" + type, Single<T>{value});
+}
+
+void scalars(Suite &suite) {
+  scalar(suite, "bool", true);
+  scalar(suite, "int8", std::numeric_limits<int8_t>::min());
+  scalar(suite, "int16", std::numeric_limits<int16_t>::min());
+  scalar(suite, "int32", std::numeric_limits<int32_t>::min());
+  scalar(suite, "int64", std::numeric_limits<int64_t>::min());
+  scalar(suite, "uint8", std::numeric_limits<uint8_t>::max());
+  scalar(suite, "uint16", std::numeric_limits<uint16_t>::max());
+  scalar(suite, "uint32", std::numeric_limits<uint32_t>::max());
+  scalar(suite, "uint64", std::numeric_limits<uint64_t>::max());
+  scalar(suite, "float", 3.14159f);
+  scalar(suite, "double", 2.718281828459045);
+}
+
+void strings(Suite &suite) {
+  for (auto size : {8, 64, 1024, 65536}) {
+    pack_and_unpack(suite, "string/" + std::to_string(size), Single<std::string>{std::string(std::size_t(size), 's')});
+  }
+}
+
+void vectors(Suite &suite) {
+  constexpr auto count = std::size_t{100000};
+  auto doubles = std::vector<double>(count);
+  auto small_ints = std::vector<int32_t>(count);
+  auto wide_ints = std::vector<uint64_t>(count);
+  auto bytes = std::vector<uint8_t>(count * 10);
+  for (auto i = std::size_t{0}; i < count; ++i) {
+    doubles[i] = double(i) * 0.37;
+    small_ints[i] = int32_t(i % 200) - 100;
+    wide_ints[i] = uint64_t(i) * 0x9e3779b97f4a7c15ULL;
+  }
+  pack_and_unpack(suite, "vector/double x100000", Single<std::vector<double>>{doubles});
+  pack_and_unpack(suite, "vector/int32 x100000", Single<std::vector<int32_t>>{small_ints});
+  pack_and_unpack(suite, "vector/uint64 x100000", Single<std::vector<uint64_t>>{wide_ints});
+  pack_and_unpack(suite, "vector/bin 1MB", Single<std::vector<uint8_t>>{bytes});
+}
+
+void maps(Suite &suite) {
+  auto ordered = std::map<std::string, int64_t>{};
+  auto hashed = std::unordered_map<uint32_t, std::string>{};
+  for (auto i = 0; i < 1000; ++i) {
+    ordered["key " + std::to_string(i)] = int64_t(i) * 1000;
+    hashed[uint32_t(i)] = "value " + std::to_string(i);
+  }
+  pack_and_unpack(suite, "map/string->int64 x1000", Single<std::map<std::string, int64_t>>{ordered});
+  pack_and_unpack(suite, "map/uint32->string x1000", Single<std::unordered_map<uint32_t, std::string>>{hashed});
+}
+
+void objects(Suite &suite) {
+  pack_and_unpack(suite, "object/person", Person{"John", 22, {"Ripper", "Silverhand"}});
+  auto team = Team{"Team", {}, {}};
+  for (auto i = std::size_t{0}; i < 100; ++i) {
+    team.members.push_back(make_person(i));
+    team.ratings["member " + std::to_string(i)] = double(i) / 7;
+  }
+  pack_and_unpack(suite, "object/team of 100", team);
+}
+
+// The free functions, which manage their own buffers
+void free_functions(Suite &suite) {
+  auto person = Person{"John", 22, {"Ripper", "Silverhand"}};
+  auto size = msgpack::pack(person).size();
+  suite.run("api/pack() person", "pack", size, [&] {
+    auto data = msgpack::pack(person);
+    keep(data);
+  });
+  suite.run("api/pack_pooled() person", "pack", size, [&] {
+    auto data = msgpack::pack_pooled(person);
+    keep(data);
+  });
+}
+
+void parallel(Suite &suite) {
+  auto people = std::vector<Person>{};
+  for (auto i = std::size_t{0}; i < 100000; ++i) {
+    people.push_back(make_person(i));
+  }
+  auto buffer = std::vector<uint8_t>{};
+  auto offsets = std::vector<std::size_t>{};
+  msgpack::pack_parallel(people, buffer, offsets, 1);
+  auto size = buffer.size();
+  auto thread_counts = std::set<std::size_t>{1, 2, 4, std::max(1U, std::thread::hardware_concurrency())};
+  for (auto threads : thread_counts) {
+    suite.run("parallel/person x100000 threads=" + std::to_string(threads), "pack", size, [&] {
+      buffer.clear();
+      offsets.clear();
+      msgpack::pack_parallel(people, buffer, offsets, threads);
+      keep(buffer);
+    });
+  }
+}
+
+Options parse_options(int argc, char **argv) {
+  auto options = Options{};
+  for (auto i = 1; i < argc; ++i) {
+    auto argument = std::string{argv[i]};
+    if (argument == "--filter" && i + 1 < argc) {
+      options.filter = argv[++i];
+    } else if (argument == "--min-time" && i + 1 < argc) {
+      options.min_time = std::atof(argv[++i]);
+    } else if (argument == "--json" && i + 1 < argc) {
+      options.json_path = argv[++i];
+    } else {
+      std::fprintf(stderr, "usage: %s [--filter <text>] [--min-time <seconds>] [--json <file>]\n", argv[0]);
+      std::exit(2);
+    }
+  }
+  return options;
+}
+}
+
+int main(int argc, char **argv) {
+  auto suite = Suite{parse_options(argc, argv)};
+  scalars(suite);
+  strings(suite);
+  vectors(suite);
+  maps(suite);
+  objects(suite);
+  free_functions(suite);
+  parallel(suite);
+  suite.write_json();
+}
@@ -7,17 +7,41 @@
 
 #include <vector>
 #include <set>
+#include <unordered_set>
 #include <list>
 #include <map>
 #include <unordered_map>
 #include <array>
 #include <chrono>
 #include <cmath>
-#include <bitset>
+#include <algorithm>
+#include <system_error>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <ostream>
+#include <memory>
+#include <memory_resource>
+#include <iterator>
+#include <utility>
+#include <limits>
+#include <tuple>
+
+#if defined(__SSE2__) || defined(__SSSE3__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
 
 namespace msgpack {
 enum class UnpackerError {
-  OutOfRange = 1
+  OutOfRange = 1,
+  InvalidFormat = 2,
+  DepthLimitExceeded = 3,
+  ExtensionMismatch = 4,
+  ContainerTooLarge = 5,
+  StringTooLarge = 6,
+  AllocationLimitExceeded = 7,
+  FieldCountMismatch = 8
 };
 
 struct UnpackerErrCategory : public std::error_category {
@@ -30,13 +54,27 @@ struct UnpackerErrCategory : public std::error_category {
     switch (static_cast<msgpack::UnpackerError>(ev)) {
       case msgpack::UnpackerError::OutOfRange:
         return "tried to dereference out of range during deserialization";
+      case msgpack::UnpackerError::InvalidFormat:
+        return "found a format byte that is not part of the msgpack spec";
+      case msgpack::UnpackerError::DepthLimitExceeded:
+        return "containers were nested deeper than allowed";
+      case msgpack::UnpackerError::ExtensionMismatch:
+        return "extension type or payload doesn't match the type being unpacked";
+      case msgpack::UnpackerError::ContainerTooLarge:
+        return "an array or map had more elements than allowed";
+      case msgpack::UnpackerError::StringTooLarge:
+        return "a string or binary value was longer than allowed";
+      case msgpack::UnpackerError::AllocationLimitExceeded:
+        return "decoding would allocate more memory than allowed";
+      case msgpack::UnpackerError::FieldCountMismatch:
+        return "a nested object had a different number of fields than the type being unpacked";
       default:
         return "(unrecognized error)";
     }
   };
 };
 
-const UnpackerErrCategory theUnpackerErrCategory{};
+inline const UnpackerErrCategory theUnpackerErrCategory{};
 
 inline
 std::error_code make_error_code(msgpack::UnpackerError e) {
@@ -44,9 +82,47 @@ std::error_code make_error_code(msgpack::UnpackerError e) {
 }
 }
 
+namespace msgpack {
+enum class PackerError {
+  BufferOverflow = 1,
+  WriteFailed = 2,
+  FieldCountMismatch = 3
+};
+
+struct PackerErrCategory : public std::error_category {
+ public:
+  const char *name() const noexcept override {
+    return "packer";
+  };
+
+  std::string message(int ev) const override {
+    switch (static_cast<msgpack::PackerError>(ev)) {
+      case msgpack::PackerError::BufferOverflow:
+        return "ran out of space in the output buffer during serialization";
+      case msgpack::PackerError::WriteFailed:
+        return "failed to write serialized data to the output stream";
+      case msgpack::PackerError::FieldCountMismatch:
+        return "an object packed a different number of fields than it has msgpack_fields names";
+      default:
+        return "(unrecognized error)";
+    }
+  };
+};
+
+inline const PackerErrCategory thePackerErrCategory{};
+
+inline
+std::error_code make_error_code(msgpack::PackerError e) {
+  return {static_cast<int>(e), thePackerErrCategory};
+}
+}
+
 namespace std {
 template<>
 struct is_error_code_enum<msgpack::UnpackerError> : public true_type {};
+
+template<>
+struct is_error_code_enum<msgpack::PackerError> : public true_type {};
 }
 
 namespace msgpack {
@@ -91,33 +167,39 @@ enum FormatConstants : uint8_t {
   map32 = 0xdf
 };
 
+// Any allocator and comparator or hash, so the std::pmr aliases count too
 template<class T>
 struct is_container {
   static const bool value = false;
 };
 
-template<class T, class Alloc>
-struct is_container<std::vector<T, Alloc> > {
+template<class ... Args>
+struct is_container<std::vector<Args...> > {
   static const bool value = true;
 };
 
-template<class T, class Alloc>
-struct is_container<std::list<T, Alloc> > {
+template<class ... Args>
+struct is_container<std::list<Args...> > {
   static const bool value = true;
 };
 
-template<class T, class Alloc>
-struct is_container<std::map<T, Alloc> > {
+template<class ... Args>
+struct is_container<std::map<Args...> > {
   static const bool value = true;
 };
 
-template<class T, class Alloc>
-struct is_container<std::unordered_map<T, Alloc> > {
+template<class ... Args>
+struct is_container<std::unordered_map<Args...> > {
   static const bool value = true;
 };
 
-template<class T, class Alloc>
-struct is_container<std::set<T, Alloc> > {
+template<class ... Args>
+struct is_container<std::set<Args...> > {
+  static const bool value = true;
+};
+
+template<class ... Args>
+struct is_container<std::unordered_set<Args...> > {
   static const bool value = true;
 };
 
@@ -136,921 +218,3668 @@ struct is_map {
   static const bool value = false;
 };
 
-template<class T, class Alloc>
-struct is_map<std::map<T, Alloc> > {
+template<class ... Args>
+struct is_map<std::map<Args...> > {
   static const bool value = true;
 };
 
-template<class T, class Alloc>
-struct is_map<std::unordered_map<T, Alloc> > {
+template<class ... Args>
+struct is_map<std::unordered_map<Args...> > {
   static const bool value = true;
 };
 
-class Packer {
+// Non-owning view of a bin payload. Unpacking into a bin_view or std::string_view points into the input buffer
+// instead of copying, so the buffer has to outlive every view decoded from it.
+class bin_view {
  public:
+  constexpr bin_view() = default;
 
-  template<class ... Types>
-  void operator()(const Types &... args) {
-    (pack_type(std::forward<const Types &>(args)), ...);
-  }
+  constexpr bin_view(const uint8_t *data, std::size_t size) : data_start(data), bytes(size) {};
 
-  template<class ... Types>
-  void process(const Types &... args) {
-    (pack_type(std::forward<const Types &>(args)), ...);
+  constexpr const uint8_t *data() const {
+    return data_start;
   }
 
-  const std::vector<uint8_t> &vector() const {
-    return serialized_object;
+  constexpr std::size_t size() const {
+    return bytes;
   }
 
-  void clear() {
-    serialized_object.clear();
+  constexpr bool empty() const {
+    return bytes == 0;
   }
 
- private:
-  std::vector<uint8_t> serialized_object;
-
-  template<class T>
-  void pack_type(const T &value) {
-    if constexpr(is_map<T>::value) {
-      pack_map(value);
-    } else if constexpr (is_container<T>::value || is_stdarray<T>::value) {
-      pack_array(value);
-    } else {
-      auto recursive_packer = Packer{};
-      const_cast<T &>(value).pack(recursive_packer);
-      pack_type(recursive_packer.vector());
-    }
+  constexpr const uint8_t *begin() const {
+    return data_start;
   }
 
-  template<class T>
-  void pack_type(const std::chrono::time_point<T> &value) {
-    pack_type(value.time_since_epoch().count());
+  constexpr const uint8_t *end() const {
+    return data_start + bytes;
   }
 
-  template<class T>
-  void pack_array(const T &array) {
-    if (array.size() < 16) {
-      auto size_mask = uint8_t(0b10010000);
-      serialized_object.emplace_back(uint8_t(array.size() | size_mask));
-    } else if (array.size() < std::numeric_limits<uint16_t>::max()) {
-      serialized_object.emplace_back(array16);
-      for (auto i = sizeof(uint16_t); i > 0; --i) {
-        serialized_object.emplace_back(uint8_t(array.size() >> (8U * (i - 1)) & 0xff));
-      }
-    } else if (array.size() < std::numeric_limits<uint32_t>::max()) {
-      serialized_object.emplace_back(array32);
-      for (auto i = sizeof(uint32_t); i > 0; --i) {
-        serialized_object.emplace_back(uint8_t(array.size() >> (8U * (i - 1)) & 0xff));
-      }
-    } else {
-      return; // Give up if string is too long
-    }
-    for (const auto &elem : array) {
-      pack_type(elem);
-    }
+  constexpr const uint8_t &operator[](std::size_t i) const {
+    return data_start[i];
   }
 
-  template<class T>
-  void pack_map(const T &map) {
-    if (map.size() < 16) {
-      auto size_mask = uint8_t(0b10000000);
-      serialized_object.emplace_back(uint8_t(map.size() | size_mask));
-    } else if (map.size() < std::numeric_limits<uint16_t>::max()) {
-      serialized_object.emplace_back(map16);
-      for (auto i = sizeof(uint16_t); i > 0; --i) {
-        serialized_object.emplace_back(uint8_t(map.size() >> (8U * (i - 1)) & 0xff));
-      }
-    } else if (map.size() < std::numeric_limits<uint32_t>::max()) {
-      serialized_object.emplace_back(map32);
-      for (auto i = sizeof(uint32_t); i > 0; --i) {
-        serialized_object.emplace_back(uint8_t(map.size() >> (8U * (i - 1)) & 0xff));
-      }
-    }
-    for (const auto &elem : map) {
-      pack_type(std::get<0>(elem));
-      pack_type(std::get<1>(elem));
-    }
-  }
+ private:
+  const uint8_t *data_start = nullptr;
+  std::size_t bytes = 0;
+};
 
-  std::bitset<64> twos_complement(int64_t value) {
-    if (value < 0) {
-      auto abs_v = llabs(value);
-      return ~abs_v + 1;
-    } else {
-      return {(uint64_t) value};
-    }
-  }
+namespace detail {
+template<std::size_t N>
+struct uint_of_size;
 
-  std::bitset<32> twos_complement(int32_t value) {
-    if (value < 0) {
-      auto abs_v = abs(value);
-      return ~abs_v + 1;
-    } else {
-      return {(uint32_t) value};
-    }
-  }
+template<>
+struct uint_of_size<1> {
+  using type = uint8_t;
+};
 
-  std::bitset<16> twos_complement(int16_t value) {
-    if (value < 0) {
-      auto abs_v = abs(value);
-      return ~abs_v + 1;
-    } else {
-      return {(uint16_t) value};
-    }
-  }
+template<>
+struct uint_of_size<2> {
+  using type = uint16_t;
+};
 
-  std::bitset<8> twos_complement(int8_t value) {
-    if (value < 0) {
-      auto abs_v = abs(value);
-      return ~abs_v + 1;
-    } else {
-      return {(uint8_t) value};
-    }
-  }
+template<>
+struct uint_of_size<4> {
+  using type = uint32_t;
 };
 
 template<>
-inline
-void Packer::pack_type(const int8_t &value) {
-  if (value > 31 || value < -32) {
-    serialized_object.emplace_back(int8);
-  }
-  serialized_object.emplace_back(uint8_t(twos_complement(value).to_ulong()));
+struct uint_of_size<8> {
+  using type = uint64_t;
+};
+
+template<std::size_t N>
+using uint_t = typename uint_of_size<N>::type;
+
+#if defined(__BYTE_ORDER__) && defined(__ORDER_BIG_ENDIAN__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+constexpr bool host_is_big_endian = true;
+#else
+constexpr bool host_is_big_endian = false;
+#endif
+
+inline uint8_t byteswap(uint8_t value) {
+  return value;
 }
 
-template<>
-inline
-void Packer::pack_type(const int16_t &value) {
-  if (abs(value) < abs(std::numeric_limits<int8_t>::min())) {
-    pack_type(int8_t(value));
-  } else {
-    serialized_object.emplace_back(int16);
-    auto serialize_value = uint16_t(twos_complement(value).to_ulong());
-    for (auto i = sizeof(value); i > 0; --i) {
-      serialized_object.emplace_back(uint8_t(serialize_value >> (8U * (i - 1)) & 0xff));
-    }
-  }
+#if defined(__GNUC__) || defined(__clang__)
+inline uint16_t byteswap(uint16_t value) {
+  return __builtin_bswap16(value);
 }
 
-template<>
-inline
-void Packer::pack_type(const int32_t &value) {
-  if (abs(value) < abs(std::numeric_limits<int16_t>::min())) {
-    pack_type(int16_t(value));
-  } else {
-    serialized_object.emplace_back(int32);
-    auto serialize_value = uint32_t(twos_complement(value).to_ulong());
-    for (auto i = sizeof(value); i > 0; --i) {
-      serialized_object.emplace_back(uint8_t(serialize_value >> (8U * (i - 1)) & 0xff));
-    }
-  }
+inline uint32_t byteswap(uint32_t value) {
+  return __builtin_bswap32(value);
 }
 
-template<>
-inline
-void Packer::pack_type(const int64_t &value) {
-  if (llabs(value) < llabs(std::numeric_limits<int32_t>::min()) && value != std::numeric_limits<int64_t>::min()) {
-    pack_type(int32_t(value));
-  } else {
-    serialized_object.emplace_back(int64);
-    auto serialize_value = uint64_t(twos_complement(value).to_ullong());
-    for (auto i = sizeof(value); i > 0; --i) {
-      serialized_object.emplace_back(uint8_t(serialize_value >> (8U * (i - 1)) & 0xff));
-    }
-  }
+inline uint64_t byteswap(uint64_t value) {
+  return __builtin_bswap64(value);
+}
+#else
+inline uint16_t byteswap(uint16_t value) {
+  return uint16_t((value << 8U) | (value >> 8U));
 }
 
-template<>
-inline
-void Packer::pack_type(const uint8_t &value) {
-  if (value <= 0x7f) {
-    serialized_object.emplace_back(value);
-  } else {
-    serialized_object.emplace_back(uint8);
-    serialized_object.emplace_back(value);
-  }
+inline uint32_t byteswap(uint32_t value) {
+  return (uint32_t(byteswap(uint16_t(value))) << 16U) | byteswap(uint16_t(value >> 16U));
 }
 
-template<>
-inline
-void Packer::pack_type(const uint16_t &value) {
-  if (value > std::numeric_limits<uint8_t>::max()) {
-    serialized_object.emplace_back(uint16);
-    for (auto i = sizeof(value); i > 0U; --i) {
-      serialized_object.emplace_back(uint8_t(value >> (8U * (i - 1)) & 0xff));
-    }
-  } else {
-    pack_type(uint8_t(value));
-  }
+inline uint64_t byteswap(uint64_t value) {
+  return (uint64_t(byteswap(uint32_t(value))) << 32U) | byteswap(uint32_t(value >> 32U));
 }
+#endif
 
-template<>
-inline
-void Packer::pack_type(const uint32_t &value) {
-  if (value > std::numeric_limits<uint16_t>::max()) {
-    serialized_object.emplace_back(uint32);
-    for (auto i = sizeof(value); i > 0U; --i) {
-      serialized_object.emplace_back(uint8_t(value >> (8U * (i - 1)) & 0xff));
-    }
-  } else {
-    pack_type(uint16_t(value));
+// True when value can be packed as an int and unpacked to the same float, -0.0 keeps its float encoding
+template<class Float>
+inline bool is_int64_representable(Float value) {
+  return value == std::trunc(value) && value >= Float(-9223372036854775808.0) && value < Float(9223372036854775808.0)
+      && !(value == 0 && std::signbit(value));
+}
+
+// Big endian is the msgpack wire order, big endian hosts copy straight through
+template<std::size_t N>
+inline void store_be(uint8_t *out, uint_t<N> value) {
+  if constexpr (!host_is_big_endian) {
+    value = byteswap(value);
   }
+  std::memcpy(out, &value, N);
 }
 
-template<>
-inline
-void Packer::pack_type(const uint64_t &value) {
-  if (value > std::numeric_limits<uint32_t>::max()) {
-    serialized_object.emplace_back(uint64);
-    for (auto i = sizeof(value); i > 0U; --i) {
-      serialized_object.emplace_back(uint8_t(value >> (8U * (i - 1)) & 0xff));
-    }
-  } else {
-    pack_type(uint32_t(value));
+template<std::size_t N>
+inline uint_t<N> load_be(const uint8_t *in) {
+  auto value = uint_t<N>{};
+  std::memcpy(&value, in, N);
+  if constexpr (!host_is_big_endian) {
+    value = byteswap(value);
   }
+  return value;
+}
 }
 
+// Bulk kernels for contiguous arrays of numbers
+namespace detail {
+template<class T>
+struct fixed_format;
+
 template<>
-inline
-void Packer::pack_type(const std::nullptr_t &/*value*/) {
-  serialized_object.emplace_back(nil);
-}
+struct fixed_format<int8_t> {
+  static constexpr uint8_t value = int8;
+};
 
 template<>
-inline
-void Packer::pack_type(const bool &value) {
-  if (value) {
-    serialized_object.emplace_back(true_bool);
+struct fixed_format<int16_t> {
+  static constexpr uint8_t value = int16;
+};
+
+template<>
+struct fixed_format<int32_t> {
+  static constexpr uint8_t value = int32;
+};
+
+template<>
+struct fixed_format<int64_t> {
+  static constexpr uint8_t value = int64;
+};
+
+template<>
+struct fixed_format<uint8_t> {
+  static constexpr uint8_t value = uint8;
+};
+
+template<>
+struct fixed_format<uint16_t> {
+  static constexpr uint8_t value = uint16;
+};
+
+template<>
+struct fixed_format<uint32_t> {
+  static constexpr uint8_t value = uint32;
+};
+
+template<>
+struct fixed_format<uint64_t> {
+  static constexpr uint8_t value = uint64;
+};
+
+template<>
+struct fixed_format<float> {
+  static constexpr uint8_t value = float32;
+};
+
+template<>
+struct fixed_format<double> {
+  static constexpr uint8_t value = float64;
+};
+
+template<class T, class = void>
+struct is_number : std::false_type {};
+
+template<class T>
+struct is_number<T, std::void_t<decltype(fixed_format<T>::value)>> : std::true_type {};
+
+template<class T>
+struct is_number_array : std::false_type {};
+
+template<class T, class Alloc>
+struct is_number_array<std::vector<T, Alloc>> : is_number<T> {};
+
+template<class T, std::size_t N>
+struct is_number_array<std::array<T, N>> : is_number<T> {};
+
+template<class T>
+struct is_string : std::false_type {};
+
+template<class Traits, class Alloc>
+struct is_string<std::basic_string<char, Traits, Alloc>> : std::true_type {};
+
+// T built with allocator the way an allocator aware container builds its elements (uses-allocator construction)
+template<class T, class Alloc>
+T make_using_allocator(const Alloc &allocator) {
+  if constexpr (std::is_constructible_v<T, std::allocator_arg_t, const Alloc &>) {
+    return T(std::allocator_arg, allocator);
   } else {
-    serialized_object.emplace_back(false_bool);
+    return T(allocator);
   }
 }
 
-template<>
-inline
-void Packer::pack_type(const float &value) {
-  double integral_part;
-  auto fractional_remainder = float(modf(value, &integral_part));
+template<class T, class = void>
+struct has_reserve : std::false_type {};
 
-  if (fractional_remainder == 0) { // Just pack as int
-    pack_type(int64_t(integral_part));
-  } else {
-    static_assert(std::numeric_limits<float>::radix == 2); // TODO: Handle decimal floats
-    auto exponent = ilogb(value);
-    float full_mantissa = value / float(scalbn(1.0, exponent));
-    auto sign_mask = std::bitset<32>(uint32_t(std::signbit(full_mantissa)) << 31);
-    auto excess_127_exponent_mask = std::bitset<32>(uint32_t(exponent + 127) << 23);
-    auto normalized_mantissa_mask = std::bitset<32>();
-    float implied_mantissa = fabs(full_mantissa) - 1.0f;
-    for (auto i = 23U; i > 0; --i) {
-      integral_part = 0;
-      implied_mantissa *= 2;
-      implied_mantissa = float(modf(implied_mantissa, &integral_part));
-      if (uint8_t(integral_part) == 1) {
-        normalized_mantissa_mask |= std::bitset<32>(uint32_t(1 << (i - 1)));
-      }
-    }
+template<class T>
+struct has_reserve<T, std::void_t<decltype(std::declval<T &>().reserve(std::size_t{}))>> : std::true_type {};
 
-    uint32_t ieee754_float32 = (sign_mask | excess_127_exponent_mask | normalized_mantissa_mask).to_ulong();
-    serialized_object.emplace_back(float32);
-    for (auto i = sizeof(uint32_t); i > 0; --i) {
-      serialized_object.emplace_back(uint8_t(ieee754_float32 >> (8U * (i - 1)) & 0xff));
-    }
+// Bytes of output staged on the stack before each sink write
+constexpr std::size_t bulk_chunk_size = 4096;
+
+template<class T>
+inline uint_t<sizeof(T)> to_bits(T value) {
+  uint_t<sizeof(T)> bits;
+  std::memcpy(&bits, &value, sizeof(T));
+  return bits;
+}
+
+template<class T>
+inline T from_bits(uint_t<sizeof(T)> bits) {
+  T value;
+  std::memcpy(&value, &bits, sizeof(T));
+  return value;
+}
+
+constexpr std::size_t max_number_size = 9;
+
+// Writes the smallest encoding of value and returns its size
+inline std::size_t encode_int(uint8_t *out, int64_t value) {
+  if (value >= -32 && value <= 127) {
+    out[0] = uint8_t(value);
+    return 1;
+  } else if (value >= std::numeric_limits<int8_t>::min() && value <= std::numeric_limits<int8_t>::max()) {
+    out[0] = int8;
+    store_be<1>(out + 1, uint8_t(value));
+    return 2;
+  } else if (value >= std::numeric_limits<int16_t>::min() && value <= std::numeric_limits<int16_t>::max()) {
+    out[0] = int16;
+    store_be<2>(out + 1, uint16_t(value));
+    return 3;
+  } else if (value >= std::numeric_limits<int32_t>::min() && value <= std::numeric_limits<int32_t>::max()) {
+    out[0] = int32;
+    store_be<4>(out + 1, uint32_t(value));
+    return 5;
   }
+  out[0] = int64;
+  store_be<8>(out + 1, uint64_t(value));
+  return 9;
 }
 
-template<>
-inline
-void Packer::pack_type(const double &value) {
-  double integral_part;
-  double fractional_remainder = modf(value, &integral_part);
+inline std::size_t encode_uint(uint8_t *out, uint64_t value) {
+  if (value <= 0x7f) {
+    out[0] = uint8_t(value);
+    return 1;
+  } else if (value <= std::numeric_limits<uint8_t>::max()) {
+    out[0] = uint8;
+    store_be<1>(out + 1, uint8_t(value));
+    return 2;
+  } else if (value <= std::numeric_limits<uint16_t>::max()) {
+    out[0] = uint16;
+    store_be<2>(out + 1, uint16_t(value));
+    return 3;
+  } else if (value <= std::numeric_limits<uint32_t>::max()) {
+    out[0] = uint32;
+    store_be<4>(out + 1, uint32_t(value));
+    return 5;
+  }
+  out[0] = uint64;
+  store_be<8>(out + 1, value);
+  return 9;
+}
 
-  if (fractional_remainder == 0) { // Just pack as int
-    pack_type(int64_t(integral_part));
+template<class T>
+inline std::size_t encode_number(uint8_t *out, T value, bool preserve_float_type) {
+  if constexpr (std::is_floating_point_v<T>) {
+    static_assert(std::numeric_limits<T>::is_iec559);
+    if (!preserve_float_type && is_int64_representable(value)) { // Just pack as int
+      return encode_int(out, int64_t(value));
+    }
+    out[0] = fixed_format<T>::value;
+    store_be<sizeof(T)>(out + 1, to_bits(value));
+    return sizeof(T) + 1;
+  } else if constexpr (std::is_signed_v<T>) {
+    return encode_int(out, value);
   } else {
-    static_assert(std::numeric_limits<float>::radix == 2); // TODO: Handle decimal floats
-    auto exponent = ilogb(value);
-    double full_mantissa = value / scalbn(1.0, exponent);
-    auto sign_mask = std::bitset<64>(uint64_t(std::signbit(full_mantissa)) << 63);
-    auto excess_127_exponent_mask = std::bitset<64>(uint64_t(exponent + 1023) << 52);
-    auto normalized_mantissa_mask = std::bitset<64>();
-    double implied_mantissa = fabs(full_mantissa) - 1.0f;
-
-    for (auto i = 52U; i > 0; --i) {
-      integral_part = 0;
-      implied_mantissa *= 2;
-      implied_mantissa = modf(implied_mantissa, &integral_part);
-      if (uint8_t(integral_part) == 1) {
-        normalized_mantissa_mask |= std::bitset<64>(uint64_t(1) << (i - 1));
-      }
+    return encode_uint(out, value);
+  }
+}
+
+// Writes count values as format byte + big endian payload, out needs 16 bytes of slack for the SIMD stores
+template<class T>
+inline void encode_fixed(uint8_t *out, const T *values, std::size_t count) {
+  constexpr auto N = sizeof(T);
+  constexpr auto format = fixed_format<T>::value;
+  auto i = std::size_t{0};
+#if defined(__SSE2__)
+  if constexpr (N == 1) {
+    auto formats = _mm_set1_epi8(char(format));
+    for (; i + 8 <= count; i += 8, out += 16) {
+      auto bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(values + i));
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(out), _mm_unpacklo_epi8(formats, bytes));
+    }
+  }
+#endif
+#if defined(__SSSE3__)
+  if constexpr (N == 2) {
+    auto shuffle = _mm_setr_epi8(-1, 1, 0, -1, 3, 2, -1, 5, 4, -1, 7, 6, -1, 9, 8, -1);
+    auto formats = _mm_setr_epi8(char(format), 0, 0, char(format), 0, 0, char(format), 0, 0, char(format), 0, 0,
+                                 char(format), 0, 0, 0);
+    for (; i + 8 <= count; i += 5, out += 15) {
+      auto bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(values + i));
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(out), _mm_or_si128(_mm_shuffle_epi8(bytes, shuffle), formats));
     }
-    auto ieee754_float64 = (sign_mask | excess_127_exponent_mask | normalized_mantissa_mask).to_ullong();
-    serialized_object.emplace_back(float64);
-    for (auto i = sizeof(ieee754_float64); i > 0; --i) {
-      serialized_object.emplace_back(uint8_t(ieee754_float64 >> (8U * (i - 1)) & 0xff));
+  } else if constexpr (N == 4) {
+    auto shuffle = _mm_setr_epi8(-1, 3, 2, 1, 0, -1, 7, 6, 5, 4, -1, 11, 10, 9, 8, -1);
+    auto formats = _mm_setr_epi8(char(format), 0, 0, 0, 0, char(format), 0, 0, 0, 0, char(format), 0, 0, 0, 0, 0);
+    for (; i + 4 <= count; i += 3, out += 15) {
+      auto bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(values + i));
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(out), _mm_or_si128(_mm_shuffle_epi8(bytes, shuffle), formats));
     }
+  } else if constexpr (N == 8) {
+    auto shuffle = _mm_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+    for (; i + 2 <= count; i += 2, out += 18) {
+      auto bytes = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(values + i)), shuffle);
+      out[0] = format;
+      _mm_storel_epi64(reinterpret_cast<__m128i *>(out + 1), bytes);
+      out[9] = format;
+      _mm_storel_epi64(reinterpret_cast<__m128i *>(out + 10), _mm_unpackhi_epi64(bytes, bytes));
+    }
+  }
+#endif
+  for (; i < count; ++i, out += N + 1) {
+    out[0] = format;
+    store_be<N>(out + 1, to_bits(values[i]));
   }
 }
 
-template<>
-inline
-void Packer::pack_type(const std::string &value) {
-  if (value.size() < 32) {
-    serialized_object.emplace_back(uint8_t(value.size()) | 0b10100000);
-  } else if (value.size() < std::numeric_limits<uint8_t>::max()) {
-    serialized_object.emplace_back(str8);
-    serialized_object.emplace_back(uint8_t(value.size()));
-  } else if (value.size() < std::numeric_limits<uint16_t>::max()) {
-    serialized_object.emplace_back(str16);
-    for (auto i = sizeof(uint16_t); i > 0; --i) {
-      serialized_object.emplace_back(uint8_t(value.size() >> (8U * (i - 1)) & 0xff));
+// Number of leading bytes that are fixints, negative ones only count when signed is set
+inline std::size_t fixint_bytes(const uint8_t *data, std::size_t size, bool is_signed) {
+  auto i = std::size_t{0};
+#if defined(__AVX2__)
+  auto lowest_negative_fixint = _mm256_set1_epi8(-33);
+  for (; i + 32 <= size; i += 32) {
+    auto bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+    auto fixints = is_signed ? _mm256_cmpgt_epi8(bytes, lowest_negative_fixint)
+                             : _mm256_cmpgt_epi8(bytes, _mm256_set1_epi8(-1));
+    auto mask = ~uint32_t(_mm256_movemask_epi8(fixints));
+    if (mask != 0) {
+      return i + std::size_t(__builtin_ctz(mask));
     }
-  } else if (value.size() < std::numeric_limits<uint32_t>::max()) {
-    serialized_object.emplace_back(str32);
-    for (auto i = sizeof(uint32_t); i > 0; --i) {
-      serialized_object.emplace_back(uint8_t(value.size() >> (8U * (i - 1)) & 0xff));
+  }
+#endif
+#if defined(__SSE2__)
+  auto lowest_negative_fixint_128 = _mm_set1_epi8(-33);
+  for (; i + 16 <= size; i += 16) {
+    auto bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+    auto fixints = is_signed ? _mm_cmpgt_epi8(bytes, lowest_negative_fixint_128)
+                             : _mm_cmpgt_epi8(bytes, _mm_set1_epi8(-1));
+    auto mask = ~uint32_t(_mm_movemask_epi8(fixints)) & 0xffffU;
+    if (mask != 0) {
+      return i + std::size_t(__builtin_ctz(mask));
+    }
+  }
+#endif
+  for (; i < size; ++i) {
+    if (!(data[i] < 0x80 || (is_signed && data[i] >= 0xe0))) {
+      break;
     }
-  } else {
-    return; // Give up if string is too long
   }
-  for (char i : value) {
-    serialized_object.emplace_back(static_cast<uint8_t>(i));
+  return i;
+}
+
+struct Run {
+  std::size_t count;
+  std::size_t bytes;
+};
+
+// Decodes values that all share the format byte at data[0]
+template<class T, class Wire>
+inline Run decode_fixed_run(const uint8_t *data, std::size_t size, T *out, std::size_t count) {
+  constexpr auto N = sizeof(Wire);
+  auto format = data[0];
+  auto limit = std::min(count, size / (N + 1));
+  auto i = std::size_t{0};
+  for (; i < limit && data[0] == format; ++i, data += N + 1) {
+    out[i] = T(from_bits<Wire>(load_be<N>(data + 1)));
   }
+  return {i, i * (N + 1)};
 }
 
-template<>
-inline
-void Packer::pack_type(const std::vector<uint8_t> &value) {
-  if (value.size() < std::numeric_limits<uint8_t>::max()) {
-    serialized_object.emplace_back(bin8);
-    serialized_object.emplace_back(uint8_t(value.size()));
-  } else if (value.size() < std::numeric_limits<uint16_t>::max()) {
-    serialized_object.emplace_back(bin16);
-    for (auto i = sizeof(uint16_t); i > 0; --i) {
-      serialized_object.emplace_back(uint8_t(value.size() >> (8U * (i - 1)) & 0xff));
+// Decodes the longest run of same-format values the Unpacker would accept for T, {0, 0} if the next value needs
+// the generic path
+template<class T>
+inline Run decode_number_run(const uint8_t *data, std::size_t size, T *out, std::size_t count) {
+  constexpr auto is_signed = std::is_signed_v<T>;
+  auto format = data[0];
+  if (format < 0x80 || (is_signed && format >= 0xe0)) {
+    auto run = fixint_bytes(data, std::min(size, count), is_signed);
+    for (auto i = std::size_t{0}; i < run; ++i) {
+      out[i] = is_signed ? T(int8_t(data[i])) : T(data[i]);
     }
-  } else if (value.size() < std::numeric_limits<uint32_t>::max()) {
-    serialized_object.emplace_back(bin32);
-    for (auto i = sizeof(uint32_t); i > 0; --i) {
-      serialized_object.emplace_back(uint8_t(value.size() >> (8U * (i - 1)) & 0xff));
+    return {run, run};
+  }
+  if constexpr (std::is_floating_point_v<T>) {
+    switch (format) {
+      case float32:
+        return decode_fixed_run<T, float>(data, size, out, count);
+      case float64:
+        return decode_fixed_run<T, double>(data, size, out, count);
+      case int8:
+        return decode_fixed_run<T, int8_t>(data, size, out, count);
+      case int16:
+        return decode_fixed_run<T, int16_t>(data, size, out, count);
+      case int32:
+        return decode_fixed_run<T, int32_t>(data, size, out, count);
+      case int64:
+        return decode_fixed_run<T, int64_t>(data, size, out, count);
+      case uint8:
+        return decode_fixed_run<T, uint8_t>(data, size, out, count);
+      case uint16:
+        return decode_fixed_run<T, uint16_t>(data, size, out, count);
+      case uint32:
+        return decode_fixed_run<T, uint32_t>(data, size, out, count);
+      case uint64:
+        return decode_fixed_run<T, uint64_t>(data, size, out, count);
+      default:
+        break;
+    }
+  } else if constexpr (is_signed) {
+    if (format == int8) {
+      return decode_fixed_run<T, int8_t>(data, size, out, count);
+    } else if (format == int16 && sizeof(T) >= 2) {
+      return decode_fixed_run<T, int16_t>(data, size, out, count);
+    } else if (format == int32 && sizeof(T) >= 4) {
+      return decode_fixed_run<T, int32_t>(data, size, out, count);
+    } else if (format == int64 && sizeof(T) >= 8) {
+      return decode_fixed_run<T, int64_t>(data, size, out, count);
     }
   } else {
-    return; // Give up if vector is too large
-  }
-  for (const auto &elem : value) {
-    serialized_object.emplace_back(elem);
+    if (format == uint8) {
+      return decode_fixed_run<T, uint8_t>(data, size, out, count);
+    } else if (format == uint16 && sizeof(T) >= 2) {
+      return decode_fixed_run<T, uint16_t>(data, size, out, count);
+    } else if (format == uint32 && sizeof(T) >= 4) {
+      return decode_fixed_run<T, uint32_t>(data, size, out, count);
+    } else if (format == uint64 && sizeof(T) >= 8) {
+      return decode_fixed_run<T, uint64_t>(data, size, out, count);
+    }
   }
+  return {0, 0};
+}
 }
 
-class Unpacker {
+class VectorSink {
  public:
-  Unpacker() : data_pointer(nullptr), data_end(nullptr) {};
-
-  Unpacker(const uint8_t *data_start, std::size_t bytes)
-      : data_pointer(data_start), data_end(data_start + bytes) {};
+  bool put(uint8_t byte) {
+    buffer.emplace_back(byte);
+    return true;
+  }
 
-  template<class ... Types>
-  void operator()(Types &... args) {
-    (unpack_type(std::forward<Types &>(args)), ...);
+  bool write(const uint8_t *data, std::size_t size) {
+    buffer.insert(buffer.end(), data, data + size);
+    return true;
   }
 
-  template<class ... Types>
-  void process(Types &... args) {
-    (unpack_type(std::forward<Types &>(args)), ...);
+  std::error_code error() const {
+    return {};
   }
 
-  void set_data(const uint8_t *pointer, std::size_t size) {
-    data_pointer = pointer;
-    data_end = data_pointer + size;
+  const std::vector<uint8_t> &vector() const {
+    return buffer;
   }
 
-  std::error_code ec{};
+  void clear() {
+    buffer.clear();
+  }
 
  private:
-  const uint8_t *data_pointer;
-  const uint8_t *data_end;
+  std::vector<uint8_t> buffer;
+};
 
-  uint8_t safe_data() {
-    if (data_pointer < data_end)
-      return *data_pointer;
-    ec = UnpackerError::OutOfRange;
-    return 0;
+class VectorRefSink {
+ public:
+  explicit VectorRefSink(std::vector<uint8_t> &target) : buffer(&target) {};
+
+  bool put(uint8_t byte) {
+    buffer->emplace_back(byte);
+    return true;
   }
 
-  void safe_increment(int64_t bytes = 1) {
-    if (data_end - data_pointer >= 0) {
-      data_pointer += bytes;
-    } else {
-      ec = UnpackerError::OutOfRange;
-    }
+  bool write(const uint8_t *data, std::size_t size) {
+    buffer->insert(buffer->end(), data, data + size);
+    return true;
   }
 
-  template<class T>
-  void unpack_type(T &value) {
-    if constexpr(is_map<T>::value) {
-      unpack_map(value);
-    } else if constexpr (is_container<T>::value) {
-      unpack_array(value);
-    } else if constexpr (is_stdarray<T>::value) {
-      unpack_stdarray(value);
-    } else {
-      auto recursive_data = std::vector<uint8_t>{};
-      unpack_type(recursive_data);
+  std::error_code error() const {
+    return {};
+  }
 
-      auto recursive_unpacker = Unpacker{recursive_data.data(), recursive_data.size()};
-      value.pack(recursive_unpacker);
-      ec = recursive_unpacker.ec;
-    }
+  const std::vector<uint8_t> &vector() const {
+    return *buffer;
   }
 
-  template<class Clock, class Duration>
-  void unpack_type(std::chrono::time_point<Clock, Duration> &value) {
-    using RepType = typename std::chrono::time_point<Clock, Duration>::rep;
-    using DurationType = Duration;
-    using TimepointType = typename std::chrono::time_point<Clock, Duration>;
-    auto placeholder = RepType{};
-    unpack_type(placeholder);
-    value = TimepointType(DurationType(placeholder));
+  void clear() {
+    buffer->clear();
   }
 
-  template<class T>
-  void unpack_array(T &array) {
-    using ValueType = typename T::value_type;
-    if (safe_data() == array32) {
-      safe_increment();
-      std::size_t array_size = 0;
-      for (auto i = sizeof(uint32_t); i > 0; --i) {
-        array_size += uint32_t(safe_data()) << 8 * (i - 1);
-        safe_increment();
-      }
-      std::vector<uint32_t> x{};
-      for (auto i = 0U; i < array_size; ++i) {
-        ValueType val{};
-        unpack_type(val);
-        array.emplace_back(val);
-      }
-    } else if (safe_data() == array16) {
-      safe_increment();
-      std::size_t array_size = 0;
-      for (auto i = sizeof(uint16_t); i > 0; --i) {
-        array_size += uint16_t(safe_data()) << 8 * (i - 1);
-        safe_increment();
-      }
-      for (auto i = 0U; i < array_size; ++i) {
-        ValueType val{};
-        unpack_type(val);
-        array.emplace_back(val);
-      }
-    } else {
-      std::size_t array_size = safe_data() & 0b00001111;
-      safe_increment();
-      for (auto i = 0U; i < array_size; ++i) {
-        ValueType val{};
-        unpack_type(val);
-        array.emplace_back(val);
-      }
+ private:
+  std::vector<uint8_t> *buffer;
+};
+
+class SpanSink {
+ public:
+  SpanSink(uint8_t *data_start, std::size_t bytes)
+      : data_start(data_start), data_pointer(data_start), data_end(data_start + bytes) {};
+
+  bool put(uint8_t byte) {
+    if (overflowed || data_pointer == data_end) {
+      overflowed = true;
+      return false;
     }
+    *data_pointer++ = byte;
+    return true;
   }
 
-  template<class T>
-  void unpack_stdarray(T &array) {
-    using ValueType = typename T::value_type;
-    auto vec = std::vector<ValueType>{};
-    unpack_array(vec);
-    std::copy(vec.begin(), vec.end(), array.begin());
+  bool write(const uint8_t *data, std::size_t size) {
+    if (overflowed || std::size_t(data_end - data_pointer) < size) {
+      overflowed = true;
+      return false;
+    }
+    std::copy(data, data + size, data_pointer);
+    data_pointer += size;
+    return true;
   }
 
-  template<class T>
-  void unpack_map(T &map) {
-    using KeyType = typename T::key_type;
-    using MappedType = typename T::mapped_type;
-    if (safe_data() == map32) {
-      safe_increment();
-      std::size_t map_size = 0;
-      for (auto i = sizeof(uint32_t); i > 0; --i) {
-        map_size += uint32_t(safe_data()) << 8 * (i - 1);
-        safe_increment();
-      }
-      std::vector<uint32_t> x{};
-      for (auto i = 0U; i < map_size; ++i) {
-        KeyType key{};
-        MappedType value{};
-        unpack_type(key);
-        unpack_type(value);
-        map.insert_or_assign(key, value);
-      }
-    } else if (safe_data() == map16) {
-      safe_increment();
-      std::size_t map_size = 0;
-      for (auto i = sizeof(uint16_t); i > 0; --i) {
-        map_size += uint16_t(safe_data()) << 8 * (i - 1);
-        safe_increment();
-      }
-      for (auto i = 0U; i < map_size; ++i) {
-        KeyType key{};
-        MappedType value{};
-        unpack_type(key);
-        unpack_type(value);
-        map.insert_or_assign(key, value);
+  std::error_code error() const {
+    return overflowed ? PackerError::BufferOverflow : std::error_code{};
+  }
+
+  std::size_t size() const {
+    return std::size_t(data_pointer - data_start);
+  }
+
+  void clear() {
+    data_pointer = data_start;
+    overflowed = false;
+  }
+
+ private:
+  uint8_t *data_start;
+  uint8_t *data_pointer;
+  uint8_t *data_end;
+  bool overflowed = false;
+};
+
+template<class OutputIt>
+class IteratorSink {
+ public:
+  explicit IteratorSink(OutputIt out) : out(out) {};
+
+  bool put(uint8_t byte) {
+    *out++ = byte;
+    return true;
+  }
+
+  bool write(const uint8_t *data, std::size_t size) {
+    out = std::copy(data, data + size, out);
+    return true;
+  }
+
+  std::error_code error() const {
+    return {};
+  }
+
+  OutputIt iterator() const {
+    return out;
+  }
+
+ private:
+  OutputIt out;
+};
+
+// Collects output in a fixed size buffer and hands it to Writer whenever the buffer fills, so memory use doesn't grow
+// with the message. Writes at least as large as the buffer go straight through. Call flush() once packing is done.
+template<class Writer>
+class BufferedSink {
+ public:
+  static constexpr std::size_t default_capacity = 64 * 1024;
+
+  explicit BufferedSink(Writer writer, std::size_t capacity = default_capacity)
+      : writer(std::move(writer)), buffer(new uint8_t[capacity]), capacity(capacity) {};
+
+  bool put(uint8_t byte) {
+    if (used == capacity && !flush()) {
+      return false;
+    }
+    buffer[used++] = byte;
+    return true;
+  }
+
+  bool write(const uint8_t *data, std::size_t size) {
+    if (size > capacity - used) {
+      if (!flush()) {
+        return false;
       }
-    } else {
-      std::size_t map_size = safe_data() & 0b00001111;
-      safe_increment();
-      for (auto i = 0U; i < map_size; ++i) {
-        KeyType key{};
-        MappedType value{};
-        unpack_type(key);
-        unpack_type(value);
-        map.insert_or_assign(key, value);
+      if (size >= capacity) {
+        return writer.write(data, size);
       }
     }
+    std::copy(data, data + size, buffer.get() + used);
+    used += size;
+    return true;
+  }
+
+  bool flush() {
+    auto size = used;
+    used = 0;
+    return size == 0 || writer.write(buffer.get(), size);
+  }
+
+  std::error_code error() const {
+    return writer.error();
   }
+
+  // Bytes waiting for the next flush
+  std::size_t buffered() const {
+    return used;
+  }
+
+ private:
+  Writer writer;
+  std::unique_ptr<uint8_t[]> buffer;
+  std::size_t capacity;
+  std::size_t used = 0;
 };
 
-template<>
-inline
-void Unpacker::unpack_type(int8_t &value) {
-  if (safe_data() == int8) {
-    safe_increment();
-    value = safe_data();
-    safe_increment();
-  } else {
-    value = safe_data();
-    safe_increment();
+class OstreamWriter {
+ public:
+  explicit OstreamWriter(std::ostream &stream) : stream(&stream) {};
+
+  bool write(const uint8_t *data, std::size_t size) {
+    stream->write(reinterpret_cast<const char *>(data), std::streamsize(size));
+    return bool(*stream);
+  }
+
+  std::error_code error() const {
+    return *stream ? std::error_code{} : PackerError::WriteFailed;
+  }
+
+ private:
+  std::ostream *stream;
+};
+
+class OstreamSink : public BufferedSink<OstreamWriter> {
+ public:
+  explicit OstreamSink(std::ostream &stream, std::size_t capacity = default_capacity)
+      : BufferedSink<OstreamWriter>(OstreamWriter{stream}, capacity) {};
+};
+
+// Only counts bytes, for measuring an object before packing it
+class CountingSink {
+ public:
+  bool put(uint8_t /*byte*/) {
+    ++bytes;
+    return true;
+  }
+
+  bool write(const uint8_t * /*data*/, std::size_t size) {
+    bytes += size;
+    return true;
+  }
+
+  std::error_code error() const {
+    return {};
+  }
+
+  std::size_t size() const {
+    return bytes;
   }
+
+  void clear() {
+    bytes = 0;
+  }
+
+ private:
+  std::size_t bytes = 0;
+};
+
+struct PackerOptions {
+  // Wrap nested objects in a bin blob the way cppack 1.0 did, instead of writing them inline as an array
+  bool nested_as_bin = false;
+  // Always write float and double as float32/float64, instead of packing integral values as ints
+  bool preserve_float_type = false;
+  // Write every element of a std::vector or std::array of numbers in its own fixed width format, skipping the search
+  // for the smallest encoding
+  bool fixed_width_arrays = false;
+};
+
+class FieldCounter {
+ public:
+  template<class ... Types>
+  constexpr void operator()(const Types &... /*args*/) {
+    count += sizeof...(Types);
+  }
+
+  template<class ... Types>
+  constexpr void process(const Types &... /*args*/) {
+    count += sizeof...(Types);
+  }
+
+  std::size_t count = 0;
+};
+
+template<class PackableObject>
+std::size_t field_count(PackableObject &obj) {
+  auto counter = FieldCounter{};
+  obj.pack(counter);
+  return counter.count;
 }
 
-template<>
-inline
-void Unpacker::unpack_type(int16_t &value) {
-  if (safe_data() == int16) {
-    safe_increment();
-    std::bitset<16> bits;
-    for (auto i = sizeof(uint16_t); i > 0; --i) {
-      bits |= uint16_t(safe_data()) << 8 * (i - 1);
-      safe_increment();
-    }
-    if (bits[15]) {
-      value = -1 * (uint16_t((~bits).to_ulong()) + 1);
-    } else {
-      value = uint16_t(bits.to_ulong());
-    }
-  } else if (safe_data() == int8) {
-    int8_t val;
-    unpack_type(val);
-    value = val;
-  } else {
-    value = safe_data();
-    safe_increment();
+namespace detail {
+template<class T, class = void>
+struct has_msgpack_fields : std::false_type {};
+
+template<class T>
+struct has_msgpack_fields<T, std::void_t<decltype(T::msgpack_fields)>> : std::true_type {};
+
+// Spreads every bit of hash over the low bits, which pick buckets and slots
+constexpr uint32_t mix_hash(uint32_t hash) {
+  hash ^= hash >> 16;
+  hash *= 0x85ebca6bu;
+  hash ^= hash >> 13;
+  hash *= 0xc2b2ae35u;
+  return hash ^ (hash >> 16);
+}
+
+constexpr uint32_t field_hash(std::string_view key) {
+  auto hash = 2166136261u;
+  for (auto c : key) {
+    hash = (hash ^ uint8_t(c)) * 16777619u;
   }
+  return mix_hash(hash);
 }
 
-template<>
-inline
-void Unpacker::unpack_type(int32_t &value) {
-  if (safe_data() == int32) {
-    safe_increment();
-    std::bitset<32> bits;
-    for (auto i = sizeof(uint32_t); i > 0; --i) {
-      bits |= uint32_t(safe_data()) << 8 * (i - 1);
-      safe_increment();
-    }
-    if (bits[31]) {
-      value = -1 * ((~bits).to_ulong() + 1);
-    } else {
-      value = bits.to_ulong();
+// Perfect hash over the msgpack_fields of T, built at compile time by hash and displace: names are split into small
+// buckets by their hash, and each bucket, largest first, gets the first displacement that moves all of its names into
+// free slots. Lookups hash the key once and read one displacement and one slot.
+template<class T>
+class FieldTable {
+ public:
+  static constexpr std::size_t count = T::msgpack_fields.size();
+
+  // Index of key in msgpack_fields, count if it isn't one of them
+  static std::size_t find(std::string_view key) {
+    auto hash = field_hash(key);
+    auto index = layout.slots[slot_of(hash, layout.displacements[hash & (bucket_count - 1)])];
+    return index != 0 && T::msgpack_fields[index - 1u] == key ? index - 1u : count;
+  }
+
+ private:
+  // Building the table takes a few thousand constexpr operations per name, which keeps this many names well inside
+  // the default limits of compilers
+  static_assert(count > 0 && count <= 4096, "msgpack_fields needs between 1 and 4096 names");
+
+  static constexpr std::size_t power_of_two_at_least(std::size_t size) {
+    auto power = std::size_t{1};
+    while (power < size) {
+      power *= 2;
     }
-  } else if (safe_data() == int16) {
-    int16_t val;
-    unpack_type(val);
-    value = val;
-  } else if (safe_data() == int8) {
-    int8_t val;
-    unpack_type(val);
-    value = val;
-  } else {
-    value = safe_data();
-    safe_increment();
+    return power;
   }
-}
 
-template<>
-inline
-void Unpacker::unpack_type(int64_t &value) {
-  if (safe_data() == int64) {
-    safe_increment();
-    std::bitset<64> bits;
-    for (auto i = sizeof(value); i > 0; --i) {
-      bits |= std::bitset<8>(safe_data()).to_ullong() << 8 * (i - 1);
-      safe_increment();
+  static constexpr std::size_t slot_count = power_of_two_at_least(2 * count);
+  static constexpr std::size_t bucket_count = power_of_two_at_least((count + 1) / 2);
+
+  struct Layout {
+    // Index + 1 of the field in each slot, 0 for free slots
+    std::array<uint16_t, slot_count> slots{};
+    std::array<uint32_t, bucket_count> displacements{};
+    // False if some bucket couldn't be placed, which only happens when two names hash the same
+    bool complete = true;
+  };
+
+  // Plenty for buckets of distinct hashes, which place within a few tries at this load
+  static constexpr uint32_t max_displacement = 1u << 16;
+
+  static constexpr std::size_t slot_of(uint32_t hash, uint32_t displacement) {
+    return mix_hash(hash ^ displacement) & (slot_count - 1);
+  }
+
+  static constexpr Layout build() {
+    auto hashes = std::array<uint32_t, count>{};
+    auto bucket_starts = std::array<std::size_t, bucket_count + 1>{};
+    for (auto i = std::size_t{0}; i < count; ++i) {
+      hashes[i] = field_hash(T::msgpack_fields[i]);
+      ++bucket_starts[(hashes[i] & (bucket_count - 1)) + 1];
     }
-    if (bits[63]) {
-      value = -1 * ((~bits).to_ullong() + 1);
-    } else {
-      value = bits.to_ullong();
+    auto largest = std::size_t{0};
+    for (auto bucket = std::size_t{0}; bucket < bucket_count; ++bucket) {
+      largest = std::max(largest, bucket_starts[bucket + 1]);
+      bucket_starts[bucket + 1] += bucket_starts[bucket];
     }
-  } else if (safe_data() == int32) {
-    int32_t val;
-    unpack_type(val);
-    value = val;
-  } else if (safe_data() == int16) {
-    int16_t val;
-    unpack_type(val);
-    value = val;
-  } else if (safe_data() == int8) {
-    int8_t val;
-    unpack_type(val);
-    value = val;
-  } else {
-    value = safe_data();
-    safe_increment();
+    // Field indices grouped by bucket
+    auto members = std::array<uint16_t, count>{};
+    auto filled = bucket_starts;
+    for (auto i = std::size_t{0}; i < count; ++i) {
+      members[filled[hashes[i] & (bucket_count - 1)]++] = uint16_t(i);
+    }
+
+    auto layout = Layout{};
+    for (auto size = largest; size > 0; --size) {
+      for (auto bucket = std::size_t{0}; bucket < bucket_count; ++bucket) {
+        if (bucket_starts[bucket + 1] - bucket_starts[bucket] != size) {
+          continue;
+        }
+        for (auto i = bucket_starts[bucket]; i < bucket_starts[bucket + 1]; ++i) {
+          for (auto j = bucket_starts[bucket]; j < i; ++j) {
+            if (hashes[members[i]] == hashes[members[j]]) { // No displacement can separate these
+              layout.complete = false;
+              return layout;
+            }
+          }
+        }
+        for (auto displacement = uint32_t{0};; ++displacement) {
+          if (displacement == max_displacement) {
+            layout.complete = false;
+            return layout;
+          }
+          auto placed = bucket_starts[bucket];
+          for (; placed < bucket_starts[bucket + 1]; ++placed) {
+            auto &slot = layout.slots[slot_of(hashes[members[placed]], displacement)];
+            if (slot != 0) {
+              break;
+            }
+            slot = uint16_t(members[placed] + 1);
+          }
+          if (placed == bucket_starts[bucket + 1]) {
+            layout.displacements[bucket] = displacement;
+            break;
+          }
+          while (placed-- > bucket_starts[bucket]) { // Take back the names that did fit
+            layout.slots[slot_of(hashes[members[placed]], displacement)] = 0;
+          }
+        }
+      }
+    }
+    return layout;
   }
+
+  static constexpr Layout layout = build();
+  static_assert(layout.complete, "msgpack_fields has duplicate names, or two names with the same 32 bit hash");
+};
 }
 
-template<>
-inline
-void Unpacker::unpack_type(uint8_t &value) {
-  if (safe_data() == uint8) {
-    safe_increment();
-    value = safe_data();
-    safe_increment();
+// Number of values a packed PackableObject consists of at the top level: its fields, or one map for types with
+// msgpack_fields
+template<class PackableObject>
+std::size_t message_values(PackableObject &obj) {
+  if constexpr (detail::has_msgpack_fields<PackableObject>::value) {
+    return 1;
   } else {
-    value = safe_data();
-    safe_increment();
+    return field_count(obj);
   }
 }
 
-template<>
-inline
-void Unpacker::unpack_type(uint16_t &value) {
-  if (safe_data() == uint16) {
-    safe_increment();
-    for (auto i = sizeof(uint16_t); i > 0; --i) {
-      value += safe_data() << 8 * (i - 1);
-      safe_increment();
+// Specialize ext_type to pack a type as a msgpack extension:
+//
+// template<>
+// struct msgpack::ext_type<Uuid> {
+//   static constexpr int8_t id = 1;             // 0 to 127, negative ids are reserved by the spec
+//   static constexpr std::size_t max_size = 16; // Largest payload pack writes
+//   static std::size_t pack(const Uuid &value, uint8_t *out);                // Returns the bytes written to out
+//   static bool unpack(const uint8_t *data, std::size_t size, Uuid &value); // False if the payload is invalid
+// };
+template<class T, class = void>
+struct ext_type;
+
+template<class T, class = void>
+struct has_ext_type : std::false_type {};
+
+template<class T>
+struct has_ext_type<T, std::void_t<decltype(ext_type<T>::id)>> : std::true_type {};
+
+// Time points are packed as the timestamp extension, in the smallest of its 32, 64 and 96 bit forms that holds them.
+// Precision finer than nanoseconds is lost.
+template<class Clock, class Duration>
+struct ext_type<std::chrono::time_point<Clock, Duration>> {
+  using TimepointType = std::chrono::time_point<Clock, Duration>;
+
+  static constexpr int8_t id = -1;
+  static constexpr std::size_t max_size = 12;
+
+  static std::size_t pack(const TimepointType &value, uint8_t *out) {
+    // Split into whole seconds and the nanoseconds on top, going through truncation so neither part can overflow
+    auto since_epoch = value.time_since_epoch();
+    auto seconds = std::chrono::duration_cast<std::chrono::seconds>(since_epoch);
+    auto remainder = std::chrono::duration_cast<std::chrono::nanoseconds>(since_epoch - seconds);
+    if (remainder.count() < 0) {
+      seconds -= std::chrono::seconds(1);
+      remainder += std::chrono::seconds(1);
     }
-  } else if (safe_data() == uint8) {
-    safe_increment();
-    value = safe_data();
-    safe_increment();
-  } else {
-    value = safe_data();
-    safe_increment();
+    auto nanoseconds = uint64_t(remainder.count());
+    auto seconds_count = int64_t(seconds.count());
+    if (uint64_t(seconds_count) >> 34 == 0) {
+      auto data = nanoseconds << 34 | uint64_t(seconds_count);
+      if (data >> 32 == 0) {
+        detail::store_be<4>(out, uint32_t(data));
+        return 4;
+      }
+      detail::store_be<8>(out, data);
+      return 8;
+    }
+    detail::store_be<4>(out, uint32_t(nanoseconds));
+    detail::store_be<8>(out + 4, uint64_t(seconds_count));
+    return 12;
   }
-}
 
-template<>
-inline
-void Unpacker::unpack_type(uint32_t &value) {
-  if (safe_data() == uint32) {
-    safe_increment();
-    for (auto i = sizeof(uint32_t); i > 0; --i) {
-      value += safe_data() << 8 * (i - 1);
-      safe_increment();
+  static bool unpack(const uint8_t *data, std::size_t size, TimepointType &value) {
+    auto seconds = int64_t{0};
+    auto nanoseconds = uint32_t{0};
+    if (size == 4) {
+      seconds = detail::load_be<4>(data);
+    } else if (size == 8) {
+      auto bits = detail::load_be<8>(data);
+      nanoseconds = uint32_t(bits >> 34);
+      seconds = int64_t(bits & 0x3ffffffff);
+    } else if (size == 12) {
+      nanoseconds = detail::load_be<4>(data);
+      seconds = int64_t(detail::load_be<8>(data + 4));
+    } else {
+      return false;
     }
-  } else if (safe_data() == uint16) {
-    safe_increment();
-    for (auto i = sizeof(uint16_t); i > 0; --i) {
-      value += safe_data() << 8 * (i - 1);
-      safe_increment();
+    if (nanoseconds >= 1000000000) {
+      return false;
     }
-  } else if (safe_data() == uint8) {
-    safe_increment();
-    value = safe_data();
-    safe_increment();
-  } else {
+    auto remainder = std::chrono::nanoseconds(nanoseconds);
+    if (seconds < 0 && nanoseconds > 0) { // Keep the intermediate values in range for the earliest time points
+      seconds += 1;
+      remainder -= std::chrono::seconds(1);
+    }
+    // Converting multiplies the seconds for durations finer than a second, so hostile input could overflow them
+    using Rep = typename Duration::rep;
+    constexpr auto checked = std::is_integral_v<Rep> && std::is_signed_v<Rep>
+        && std::ratio_less_equal_v<typename Duration::period, std::ratio<1>>;
+    if constexpr (checked) {
+      constexpr auto max_seconds = std::chrono::duration_cast<std::chrono::seconds>(Duration::max()).count();
+      constexpr auto min_seconds = std::chrono::duration_cast<std::chrono::seconds>(Duration::min()).count();
+      if (seconds > max_seconds || seconds < min_seconds) {
+        return false;
+      }
+    }
+    auto whole = std::chrono::duration_cast<Duration>(std::chrono::seconds(seconds));
+    auto part = std::chrono::duration_cast<Duration>(remainder);
+    if constexpr (checked) {
+      if ((part > Duration::zero() && whole > Duration::max() - part)
+          || (part < Duration::zero() && whole < Duration::min() - part)) {
+        return false;
+      }
+    }
+    value = TimepointType(whole + part);
+    return true;
+  }
+};
+
+namespace detail {
+template<class T>
+struct is_time_point : std::false_type {};
+
+template<class Clock, class Duration>
+struct is_time_point<std::chrono::time_point<Clock, Duration>> : std::true_type {};
+
+// Largest ext header, type byte included, in front of a payload of up to size bytes
+constexpr std::size_t ext_header_size(std::size_t size) {
+  return size <= std::numeric_limits<uint8_t>::max() ? 3 : size <= std::numeric_limits<uint16_t>::max() ? 4 : 6;
+}
+
+constexpr std::size_t array_header_size(std::size_t size) {
+  return size < 16 ? 1 : size < std::numeric_limits<uint16_t>::max() ? 3 : 5;
+}
+
+constexpr std::size_t bin_header_size(std::size_t size) {
+  return size < std::numeric_limits<uint8_t>::max() ? 2 : size < std::numeric_limits<uint16_t>::max() ? 3 : 5;
+}
+
+template<class T>
+constexpr std::size_t max_size_of();
+
+// Adds up the largest encoding of every field's type, ignoring the values
+class MaxSizeCounter {
+ public:
+  template<class ... Types>
+  constexpr void operator()(const Types &... /*args*/) {
+    size += (std::size_t{0} + ... + max_size_of<Types>());
+  }
+
+  template<class ... Types>
+  constexpr void process(const Types &... /*args*/) {
+    size += (std::size_t{0} + ... + max_size_of<Types>());
+  }
+
+  std::size_t size = 0;
+};
+
+template<class T>
+constexpr std::size_t max_fields_size() {
+  auto obj = T{};
+  auto counter = MaxSizeCounter{};
+  obj.pack(counter);
+  if constexpr (has_msgpack_fields<T>::value) {
+    auto count = T::msgpack_fields.size();
+    counter.size += count < 16 ? 1 : count < std::numeric_limits<uint16_t>::max() ? 3 : 5;
+    for (auto name : T::msgpack_fields) {
+      counter.size += (name.size() < 32 ? 1 : name.size() < std::numeric_limits<uint8_t>::max() ? 2 : 3) + name.size();
+    }
+  }
+  return counter.size;
+}
+
+template<class T>
+constexpr std::size_t max_size_of() {
+  if constexpr (std::is_same_v<T, bool> || std::is_same_v<T, std::nullptr_t>) {
+    return 1;
+  } else if constexpr (std::is_floating_point_v<T>) {
+    return max_number_size; // Integral floats outside the int32 range are packed as int64 unless preserve_float_type
+  } else if constexpr (is_number<T>::value) {
+    return 1 + sizeof(T);
+  } else if constexpr (is_stdarray<T>::value) {
+    constexpr auto size = std::tuple_size<T>::value;
+    return array_header_size(size) + size * max_size_of<typename T::value_type>();
+  } else if constexpr (has_ext_type<T>::value) {
+    return ext_header_size(ext_type<T>::max_size) + ext_type<T>::max_size;
+  } else {
+    static_assert(std::is_class_v<T> && !is_container<T>::value && !is_map<T>::value
+                      && !detail::is_string<T>::value && !std::is_same_v<T, std::string_view>
+                      && !std::is_same_v<T, bin_view>,
+                  "max_packed_size needs members of fixed size: numbers, bools, std::arrays and nested objects");
+    auto obj = T{};
+    auto fields = FieldCounter{};
+    obj.pack(fields);
+    constexpr auto content = max_fields_size<T>();
+    if constexpr (has_msgpack_fields<T>::value) {
+      return content;
+    }
+    // Nested objects start with an array header, or a bin header with PackerOptions::nested_as_bin
+    return std::max(array_header_size(fields.count), bin_header_size(content)) + content;
+  }
+}
+}
+
+// Upper bound on the packed size of T, for types whose members all have a fixed size. T has to be a literal type and
+// its pack member has to be declared constexpr so it can be run at compile time.
+template<class T>
+struct max_packed_size : std::integral_constant<std::size_t, detail::max_fields_size<T>()> {};
+
+template<class T>
+inline constexpr std::size_t max_packed_size_v = max_packed_size<T>::value;
+
+// Receives events from the packer or unpacker it is plugged into, for metrics and for catching pathological messages.
+// Every event does nothing here and, with enabled false, none of them is even called, so packers and unpackers using
+// NullHooks compile to the same code as before hooks existed. Derive from it, set enabled and hide the events you need,
+// see StatsHooks.
+struct NullHooks {
+  static constexpr bool enabled = false;
+
+  // Start of a top level pack_object or unpack_object
+  void begin_message() {}
+
+  // One value, in the order they appear in the packed data. length is the element count of an array, the entry
+  // count of a map and the data size of a string, binary or extension value, depth the number of containers around it.
+  // Unpackers report the values of a message at its end.
+  void value(uint8_t /*format*/, std::size_t /*length*/, std::size_t /*depth*/) {}
+
+  // End of the message, bytes being its packed size
+  void end_message(std::size_t /*bytes*/, const std::error_code &/*ec*/) {}
+};
+
+// Running totals of everything packed or unpacked, for exporting to a metrics system
+struct StatsHooks : NullHooks {
+  static constexpr bool enabled = true;
+
+  std::array<uint64_t, 256> format_counts{}; // Values per format byte, fix formats counted under their first byte
+  uint64_t messages = 0;
+  uint64_t failed_messages = 0;
+  uint64_t bytes = 0;
+  std::size_t largest_container = 0;         // Most elements of an array or entries of a map
+  std::size_t largest_payload = 0;           // Most bytes of a string, binary or extension value
+  std::size_t max_depth = 0;
+  std::chrono::nanoseconds total_time{};
+  std::chrono::nanoseconds max_time{};
+
+  // Values seen with this format, e.g. fixmap for all maps of up to 15 entries
+  uint64_t count(uint8_t format) const {
+    return format_counts[family(format)];
+  }
+
+  void begin_message() {
+    start = std::chrono::steady_clock::now();
+  }
+
+  void value(uint8_t format, std::size_t length, std::size_t depth) {
+    ++format_counts[family(format)];
+    auto kind = value_kind(format);
+    if (kind == ValueKind::container) {
+      largest_container = std::max(largest_container, length);
+    } else if (kind == ValueKind::payload) {
+      largest_payload = std::max(largest_payload, length);
+    }
+    max_depth = std::max(max_depth, depth);
+  }
+
+  void end_message(std::size_t message_bytes, const std::error_code &ec) {
+    auto time = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+    ++messages;
+    failed_messages += ec ? 1 : 0;
+    bytes += message_bytes;
+    total_time += time;
+    max_time = std::max(max_time, time);
+  }
+
+ private:
+  enum class ValueKind {
+    scalar,
+    container,
+    payload
+  };
+
+  std::chrono::steady_clock::time_point start{};
+
+  static uint8_t family(uint8_t format) {
+    if (format <= 0x7f) {
+      return 0x00;
+    } else if (format >= 0xe0) {
+      return 0xe0;
+    } else if (format <= 0xbf) {
+      return format >= 0xa0 ? 0xa0 : format & 0b11110000;
+    }
+    return format;
+  }
+
+  static ValueKind value_kind(uint8_t format) {
+    auto first = family(format);
+    if (first == 0x80 || first == 0x90 || format == array16 || format == array32 || format == map16
+        || format == map32) {
+      return ValueKind::container;
+    } else if (first == 0xa0 || (format >= bin8 && format <= ext32) || (format >= fixext1 && format <= str32)) {
+      return ValueKind::payload;
+    }
+    return ValueKind::scalar;
+  }
+};
+
+template<class Sink = VectorSink, class Hooks = NullHooks>
+class BasicPacker {
+ public:
+  BasicPacker() = default;
+
+  explicit BasicPacker(Sink sink, PackerOptions options = {}, Hooks hooks = {})
+      : options(options), hooks(std::move(hooks)), output(std::move(sink)) {};
+
+  explicit BasicPacker(PackerOptions options) : options(options) {};
+
+  template<class ... Types>
+  void operator()(const Types &... args) {
+    (pack_field(std::forward<const Types &>(args)), ...);
+  }
+
+  template<class ... Types>
+  void process(const Types &... args) {
+    (pack_field(std::forward<const Types &>(args)), ...);
+  }
+
+  // Packs obj as a whole message: its fields one after another, or a map of them for types with msgpack_fields
+  template<class PackableObject>
+  void pack_object(PackableObject &obj) {
+    if constexpr (Hooks::enabled) {
+      written = 0;
+      hooks.begin_message();
+    }
+    if constexpr (detail::has_msgpack_fields<PackableObject>::value) {
+      pack_field_map(obj);
+    } else {
+      obj.pack(*this);
+    }
+    if constexpr (Hooks::enabled) {
+      hooks.end_message(written, ec);
+    }
+  }
+
+  const std::vector<uint8_t> &vector() const {
+    return output.vector();
+  }
+
+  void clear() {
+    output.clear();
+    ec.clear();
+  }
+
+  Sink &sink() {
+    return output;
+  }
+
+  PackerOptions options{};
+  std::error_code ec{};
+  Hooks hooks{};
+
+ private:
+  Sink output;
+  // Only kept up to date for hooks that are enabled
+  std::size_t depth = 0;
+  std::size_t written = 0;
+  // Names to write in front of the fields of the object being packed, when it has msgpack_fields
+  const std::string_view *field_names = nullptr;
+
+  template<class T>
+  void pack_field(const T &value) {
+    if (field_names != nullptr) {
+      pack_type(*field_names++);
+    }
+    pack_type(value);
+  }
+
+  template<class T>
+  void pack_field_map(T &object) {
+    if (field_count(object) != T::msgpack_fields.size()) {
+      ec = PackerError::FieldCountMismatch;
+      return;
+    }
+    auto outer_names = field_names;
+    field_names = T::msgpack_fields.data();
+    if (pack_map_header(T::msgpack_fields.size())) {
+      enter();
+      object.pack(*this);
+      leave();
+    }
+    field_names = outer_names;
+  }
+
+  // Tells the hooks about a value just written
+  void report(uint8_t format, std::size_t length = 0) {
+    if constexpr (Hooks::enabled) {
+      hooks.value(format, length, depth);
+    }
+  }
+
+  void enter() {
+    if constexpr (Hooks::enabled) {
+      ++depth;
+    }
+  }
+
+  void leave() {
+    if constexpr (Hooks::enabled) {
+      --depth;
+    }
+  }
+
+  void put(uint8_t byte) {
+    if constexpr (Hooks::enabled) {
+      ++written;
+    }
+    if (!output.put(byte)) {
+      ec = output.error();
+    }
+  }
+
+  void write(const uint8_t *data, std::size_t size) {
+    if constexpr (Hooks::enabled) {
+      written += size;
+    }
+    if (!output.write(data, size)) {
+      ec = output.error();
+    }
+  }
+
+  template<std::size_t N, class T>
+  void put_be(uint8_t format, T value) {
+    uint8_t bytes[N + 1];
+    bytes[0] = format;
+    detail::store_be<N>(bytes + 1, static_cast<detail::uint_t<N>>(value));
+    write(bytes, N + 1);
+  }
+
+  template<class T>
+  void pack_type(const T &value) {
+    if constexpr(is_map<T>::value) {
+      pack_map(value);
+    } else if constexpr (is_container<T>::value || is_stdarray<T>::value) {
+      pack_array(value);
+    } else if constexpr (has_ext_type<T>::value) {
+      pack_ext(value);
+    } else if constexpr (detail::has_msgpack_fields<T>::value) {
+      pack_field_map(const_cast<T &>(value));
+    } else if (options.nested_as_bin) {
+      // Measure the object first so it can be written straight after its bin header
+      auto &object = const_cast<T &>(value);
+      auto counter = BasicPacker<CountingSink>{CountingSink{}, options};
+      object.pack(counter);
+      auto outer_names = std::exchange(field_names, nullptr);
+      if (pack_bin_header(counter.sink().size())) {
+        enter();
+        object.pack(*this);
+        leave();
+      }
+      field_names = outer_names;
+    } else {
+      auto &object = const_cast<T &>(value);
+      auto outer_names = std::exchange(field_names, nullptr);
+      if (pack_array_header(field_count(object))) {
+        enter();
+        object.pack(*this);
+        leave();
+      }
+      field_names = outer_names;
+    }
+  }
+
+  void pack_type(const int8_t &value);
+  void pack_type(const int16_t &value);
+  void pack_type(const int32_t &value);
+  void pack_type(const int64_t &value);
+  void pack_type(const uint8_t &value);
+  void pack_type(const uint16_t &value);
+  void pack_type(const uint32_t &value);
+  void pack_type(const uint64_t &value);
+  void pack_type(const std::nullptr_t &value);
+  void pack_type(const bool &value);
+  void pack_type(const float &value);
+  void pack_type(const double &value);
+  void pack_type(const std::string_view &value);
+  void pack_type(const bin_view &value);
+
+  template<class Traits, class Alloc>
+  void pack_type(const std::basic_string<char, Traits, Alloc> &value);
+
+  template<class Alloc>
+  void pack_type(const std::vector<uint8_t, Alloc> &value);
+
+  bool pack_array_header(std::size_t size) {
+    if (size < 16) {
+      auto size_mask = uint8_t(0b10010000);
+      put(uint8_t(size | size_mask));
+    } else if (size < std::numeric_limits<uint16_t>::max()) {
+      put_be<2>(array16, size);
+    } else if (size < std::numeric_limits<uint32_t>::max()) {
+      put_be<4>(array32, size);
+    } else {
+      return false; // Give up if array is too long
+    }
+    report(size < 16 ? uint8_t(size | 0b10010000)
+                     : uint8_t(size < std::numeric_limits<uint16_t>::max() ? array16 : array32), size);
+    return true;
+  }
+
+  bool pack_map_header(std::size_t size) {
+    if (size < 16) {
+      auto size_mask = uint8_t(0b10000000);
+      put(uint8_t(size | size_mask));
+    } else if (size < std::numeric_limits<uint16_t>::max()) {
+      put_be<2>(map16, size);
+    } else if (size < std::numeric_limits<uint32_t>::max()) {
+      put_be<4>(map32, size);
+    } else {
+      return false; // Give up if map is too long
+    }
+    report(size < 16 ? uint8_t(size | 0b10000000)
+                     : uint8_t(size < std::numeric_limits<uint16_t>::max() ? map16 : map32), size);
+    return true;
+  }
+
+  bool pack_bin_header(std::size_t size) {
+    if (size < std::numeric_limits<uint8_t>::max()) {
+      put_be<1>(bin8, size);
+    } else if (size < std::numeric_limits<uint16_t>::max()) {
+      put_be<2>(bin16, size);
+    } else if (size < std::numeric_limits<uint32_t>::max()) {
+      put_be<4>(bin32, size);
+    } else {
+      return false; // Give up if bin is too large
+    }
+    report(size < std::numeric_limits<uint8_t>::max() ? bin8
+               : size < std::numeric_limits<uint16_t>::max() ? bin16 : bin32, size);
+    return true;
+  }
+
+  bool pack_ext_header(int8_t type, std::size_t size) {
+    auto format = uint8_t{};
+    switch (size) {
+      case 1:
+        format = fixext1;
+        break;
+      case 2:
+        format = fixext2;
+        break;
+      case 4:
+        format = fixext4;
+        break;
+      case 8:
+        format = fixext8;
+        break;
+      case 16:
+        format = fixext16;
+        break;
+      default:
+        if (size <= std::numeric_limits<uint8_t>::max()) {
+          format = ext8;
+          put_be<1>(ext8, size);
+        } else if (size <= std::numeric_limits<uint16_t>::max()) {
+          format = ext16;
+          put_be<2>(ext16, size);
+        } else if (size <= std::numeric_limits<uint32_t>::max()) {
+          format = ext32;
+          put_be<4>(ext32, size);
+        } else {
+          return false; // Give up if payload is too large
+        }
+    }
+    if (format >= fixext1) { // ext8, ext16 and ext32 were written with their size above
+      put(format);
+    }
+    put(uint8_t(type));
+    report(format, size);
+    return true;
+  }
+
+  template<class T>
+  void pack_ext(const T &value) {
+    uint8_t payload[ext_type<T>::max_size];
+    auto size = ext_type<T>::pack(value, payload);
+    if (pack_ext_header(ext_type<T>::id, size)) {
+      write(payload, size);
+    }
+  }
+
+  template<class T>
+  void pack_array(const T &array) {
+    if (!pack_array_header(array.size())) {
+      return;
+    }
+    enter();
+    if constexpr (detail::is_number_array<T>::value) {
+      pack_numbers(array.data(), array.size());
+    } else {
+      for (const auto &elem : array) {
+        pack_type(elem);
+      }
+    }
+    leave();
+  }
+
+  template<class T>
+  void pack_number(T value) {
+    uint8_t bytes[detail::max_number_size];
+    write(bytes, detail::encode_number(bytes, value, options.preserve_float_type));
+    report(bytes[0]);
+  }
+
+  template<class T>
+  void pack_numbers(const T *values, std::size_t count) {
+    uint8_t chunk[detail::bulk_chunk_size + 16];
+    if (options.fixed_width_arrays) {
+      constexpr auto per_chunk = detail::bulk_chunk_size / (sizeof(T) + 1);
+      while (count > 0) {
+        auto n = std::min(count, per_chunk);
+        detail::encode_fixed(chunk, values, n);
+        write(chunk, n * (sizeof(T) + 1));
+        if constexpr (Hooks::enabled) {
+          for (auto i = std::size_t{0}; i < n; ++i) {
+            report(chunk[i * (sizeof(T) + 1)]);
+          }
+        }
+        values += n;
+        count -= n;
+      }
+      return;
+    }
+    auto size = std::size_t{0};
+    for (auto i = std::size_t{0}; i < count; ++i) {
+      if (size > detail::bulk_chunk_size) {
+        write(chunk, size);
+        size = 0;
+      }
+      auto start = size;
+      size += detail::encode_number(chunk + size, values[i], options.preserve_float_type);
+      report(chunk[start]);
+    }
+    write(chunk, size);
+  }
+
+  template<class T>
+  void pack_map(const T &map) {
+    if (!pack_map_header(map.size())) {
+      return;
+    }
+    enter();
+    for (const auto &elem : map) {
+      pack_type(std::get<0>(elem));
+      pack_type(std::get<1>(elem));
+    }
+    leave();
+  }
+};
+
+using Packer = BasicPacker<>;
+
+template<class Sink, class Hooks>
+inline
+void BasicPacker<Sink, Hooks>::pack_type(const int8_t &value) {
+  pack_number(value);
+}
+
+template<class Sink, class Hooks>
+inline
+void BasicPacker<Sink, Hooks>::pack_type(const int16_t &value) {
+  pack_number(value);
+}
+
+template<class Sink, class Hooks>
+inline
+void BasicPacker<Sink, Hooks>::pack_type(const int32_t &value) {
+  pack_number(value);
+}
+
+template<class Sink, class Hooks>
+inline
+void BasicPacker<Sink, Hooks>::pack_type(const int64_t &value) {
+  pack_number(value);
+}
+
+template<class Sink, class Hooks>
+inline
+void BasicPacker<Sink, Hooks>::pack_type(const uint8_t &value) {
+  pack_number(value);
+}
+
+template<class Sink, class Hooks>
+inline
+void BasicPacker<Sink, Hooks>::pack_type(const uint16_t &value) {
+  pack_number(value);
+}
+
+template<class Sink, class Hooks>
+inline
+void BasicPacker<Sink, Hooks>::pack_type(const uint32_t &value) {
+  pack_number(value);
+}
+
+template<class Sink, class Hooks>
+inline
+void BasicPacker<Sink, Hooks>::pack_type(const uint64_t &value) {
+  pack_number(value);
+}
+
+template<class Sink, class Hooks>
+inline
+void BasicPacker<Sink, Hooks>::pack_type(const std::nullptr_t &/*value*/) {
+  put(nil);
+  report(nil);
+}
+
+template<class Sink, class Hooks>
+inline
+void BasicPacker<Sink, Hooks>::pack_type(const bool &value) {
+  if (value) {
+    put(true_bool);
+  } else {
+    put(false_bool);
+  }
+  report(value ? true_bool : false_bool);
+}
+
+template<class Sink, class Hooks>
+inline
+void BasicPacker<Sink, Hooks>::pack_type(const float &value) {
+  pack_number(value);
+}
+
+template<class Sink, class Hooks>
+inline
+void BasicPacker<Sink, Hooks>::pack_type(const double &value) {
+  pack_number(value);
+}
+
+template<class Sink, class Hooks>
+template<class Traits, class Alloc>
+inline
+void BasicPacker<Sink, Hooks>::pack_type(const std::basic_string<char, Traits, Alloc> &value) {
+  pack_type(std::string_view{value.data(), value.size()});
+}
+
+template<class Sink, class Hooks>
+inline
+void BasicPacker<Sink, Hooks>::pack_type(const std::string_view &value) {
+  if (value.size() < 32) {
+    put(uint8_t(value.size()) | 0b10100000);
+  } else if (value.size() < std::numeric_limits<uint8_t>::max()) {
+    put_be<1>(str8, value.size());
+  } else if (value.size() < std::numeric_limits<uint16_t>::max()) {
+    put_be<2>(str16, value.size());
+  } else if (value.size() < std::numeric_limits<uint32_t>::max()) {
+    put_be<4>(str32, value.size());
+  } else {
+    return; // Give up if string is too long
+  }
+  report(value.size() < 32 ? uint8_t(value.size() | 0b10100000)
+                           : uint8_t(value.size() < std::numeric_limits<uint8_t>::max() ? str8
+                                     : value.size() < std::numeric_limits<uint16_t>::max() ? str16 : str32),
+         value.size());
+  write(reinterpret_cast<const uint8_t *>(value.data()), value.size());
+}
+
+template<class Sink, class Hooks>
+template<class Alloc>
+inline
+void BasicPacker<Sink, Hooks>::pack_type(const std::vector<uint8_t, Alloc> &value) {
+  pack_type(bin_view{value.data(), value.size()});
+}
+
+template<class Sink, class Hooks>
+inline
+void BasicPacker<Sink, Hooks>::pack_type(const bin_view &value) {
+  if (pack_bin_header(value.size())) {
+    write(value.data(), value.size());
+  }
+}
+
+namespace detail {
+struct ValueHeader {
+  std::size_t header_size;  // Format byte plus any length bytes
+  std::size_t payload_size; // Raw bytes after the header: scalar values, str/bin data, ext type and data
+  std::size_t child_count;  // Values nested directly inside, two per map entry
+};
+
+enum LengthKind : uint8_t {
+  no_length,
+  payload_length,
+  element_length,
+  entry_length
+};
+
+// Header layout of a format byte
+struct FormatLayout {
+  uint8_t header_size;   // Format byte plus length bytes, 0 for the unused format 0xc1
+  uint8_t fixed_payload; // Payload that doesn't depend on a length, e.g. a number or the type byte of an ext
+  uint8_t length_mask;   // Bits of the format byte holding the length, for fixstr, fixarray and fixmap
+  LengthKind kind;       // What the length counts
+};
+
+constexpr std::array<FormatLayout, 256> make_format_layouts() {
+  auto layouts = std::array<FormatLayout, 256>{};
+  for (auto format = 0; format < 256; ++format) {
+    layouts[format] = {1, 0, 0, no_length};
+  }
+  for (auto format = 0x80; format <= 0x8f; ++format) {
+    layouts[format] = {1, 0, 0b00001111, entry_length};
+  }
+  for (auto format = 0x90; format <= 0x9f; ++format) {
+    layouts[format] = {1, 0, 0b00001111, element_length};
+  }
+  for (auto format = 0xa0; format <= 0xbf; ++format) {
+    layouts[format] = {1, 0, 0b00011111, payload_length};
+  }
+  layouts[0xc1] = {0, 0, 0, no_length};
+  layouts[bin8] = layouts[str8] = {2, 0, 0, payload_length};
+  layouts[bin16] = layouts[str16] = {3, 0, 0, payload_length};
+  layouts[bin32] = layouts[str32] = {5, 0, 0, payload_length};
+  layouts[ext8] = {2, 1, 0, payload_length};
+  layouts[ext16] = {3, 1, 0, payload_length};
+  layouts[ext32] = {5, 1, 0, payload_length};
+  layouts[uint8] = layouts[int8] = {1, 1, 0, no_length};
+  layouts[uint16] = layouts[int16] = {1, 2, 0, no_length};
+  layouts[float32] = layouts[uint32] = layouts[int32] = {1, 4, 0, no_length};
+  layouts[float64] = layouts[uint64] = layouts[int64] = {1, 8, 0, no_length};
+  layouts[fixext1] = {1, 2, 0, no_length};
+  layouts[fixext2] = {1, 3, 0, no_length};
+  layouts[fixext4] = {1, 5, 0, no_length};
+  layouts[fixext8] = {1, 9, 0, no_length};
+  layouts[fixext16] = {1, 17, 0, no_length};
+  layouts[array16] = {3, 0, 0, element_length};
+  layouts[array32] = {5, 0, 0, element_length};
+  layouts[map16] = {3, 0, 0, entry_length};
+  layouts[map32] = {5, 0, 0, entry_length};
+  return layouts;
+}
+
+inline constexpr auto format_layouts = make_format_layouts();
+
+// Bytes needed before read_value_header can describe the value starting with format, 0 for invalid formats
+inline std::size_t header_size(uint8_t format) {
+  return format_layouts[format].header_size;
+}
+
+// Describes the value at data, which must hold at least header_size(data[0]) bytes
+inline ValueHeader read_value_header(const uint8_t *data) {
+  auto layout = format_layouts[data[0]];
+  auto length = std::size_t(data[0] & layout.length_mask);
+  switch (layout.header_size) {
+    case 2:
+      length = load_be<1>(data + 1);
+      break;
+    case 3:
+      length = load_be<2>(data + 1);
+      break;
+    case 5:
+      length = load_be<4>(data + 1);
+      break;
+    default:
+      break;
+  }
+  auto payload = layout.fixed_payload + (layout.kind == payload_length ? length : 0);
+  auto children = layout.kind == element_length ? length : layout.kind == entry_length ? 2 * length : 0;
+  return {layout.header_size, payload, children};
+}
+
+// Size of the next count values in data, found from their headers alone. 0 and ec set if they don't fit or contain
+// an invalid format byte.
+inline std::size_t skip_values(const uint8_t *data, std::size_t size, std::size_t count, std::error_code &ec) {
+  auto position = std::size_t{0};
+  while (count > 0) {
+    if (position == size) {
+      ec = UnpackerError::OutOfRange;
+      return 0;
+    }
+    auto needed = header_size(data[position]);
+    if (needed == 0) {
+      ec = UnpackerError::InvalidFormat;
+      return 0;
+    }
+    if (size - position < needed) {
+      ec = UnpackerError::OutOfRange;
+      return 0;
+    }
+    auto header = read_value_header(data + position);
+    position += header.header_size;
+    if (size - position < header.payload_size) {
+      ec = UnpackerError::OutOfRange;
+      return 0;
+    }
+    position += header.payload_size;
+    count += header.child_count - 1;
+  }
+  return position;
+}
+
+// Size of the next count values in data, checked the same way as skip_values and additionally for containers nested
+// deeper than max_depth
+inline std::size_t validate_values(const uint8_t *data, std::size_t size, std::size_t count, std::size_t max_depth,
+                                   std::error_code &ec) {
+  auto position = std::size_t{0};
+  for (; count > 0; --count) {
+    if (position == size) {
+      ec = UnpackerError::OutOfRange;
+      return 0;
+    }
+    auto layout = format_layouts[data[position]];
+    if (layout.header_size == 0) {
+      ec = UnpackerError::InvalidFormat;
+      return 0;
+    }
+    if (size - position < layout.header_size) {
+      ec = UnpackerError::OutOfRange;
+      return 0;
+    }
+    auto header = read_value_header(data + position);
+    auto value_size = header.header_size + header.payload_size;
+    if (size - position < value_size) {
+      ec = UnpackerError::OutOfRange;
+      return 0;
+    }
+    position += value_size;
+    if (header.child_count > 0) {
+      if (max_depth == 0) {
+        ec = UnpackerError::DepthLimitExceeded;
+        return 0;
+      }
+      position += validate_values(data + position, size - position, header.child_count, max_depth - 1, ec);
+      if (ec) {
+        return 0;
+      }
+    }
+  }
+  return position;
+}
+
+// Reports the complete values in the first size bytes of data to hooks, in order, see NullHooks::value
+template<class Hooks>
+inline void report_values(const uint8_t *data, std::size_t size, Hooks &hooks) {
+  auto open_containers = std::vector<std::size_t>{}; // Values still to come in each container around the position
+  auto position = std::size_t{0};
+  while (position < size) {
+    auto format = data[position];
+    auto layout = format_layouts[format];
+    if (layout.header_size == 0 || size - position < layout.header_size) {
+      return;
+    }
+    auto header = read_value_header(data + position);
+    if (size - position - header.header_size < header.payload_size) {
+      return;
+    }
+    auto length = layout.kind == element_length ? header.child_count
+                : layout.kind == entry_length ? header.child_count / 2
+                : layout.kind == payload_length ? header.payload_size - layout.fixed_payload
+                : format >= fixext1 && format <= fixext16 ? header.payload_size - 1 : 0;
+    hooks.value(format, length, open_containers.size());
+    position += header.header_size + header.payload_size;
+    if (!open_containers.empty()) {
+      --open_containers.back();
+    }
+    if (header.child_count > 0) {
+      open_containers.push_back(header.child_count);
+    }
+    while (!open_containers.empty() && open_containers.back() == 0) {
+      open_containers.pop_back();
+    }
+  }
+}
+}
+
+// What an unpacker accepts from untrusted input. Every limit is checked against a header before anything is decoded
+// or allocated for the value it starts, so hostile lengths are rejected straight away.
+struct UnpackLimits {
+  // Containers and nested objects inside each other, deeper values set UnpackerError::DepthLimitExceeded
+  std::size_t max_depth = 64;
+  // Elements of an array or entries of a map, UnpackerError::ContainerTooLarge
+  std::size_t max_container_size = std::numeric_limits<std::size_t>::max();
+  // Bytes of a string or binary value, UnpackerError::StringTooLarge
+  std::size_t max_string_size = std::numeric_limits<std::size_t>::max();
+  // Bytes allocated for strings, binary values and container elements per message, estimated from the headers and
+  // the element types, UnpackerError::AllocationLimitExceeded
+  std::size_t max_allocation = std::numeric_limits<std::size_t>::max();
+};
+
+// With BoundsChecked = false every read trusts the input and limits aren't checked, see UncheckedUnpacker
+template<bool BoundsChecked = true, class Hooks = NullHooks>
+class BasicUnpacker {
+ public:
+  BasicUnpacker() : data_pointer(nullptr), data_end(nullptr) {};
+
+  BasicUnpacker(const uint8_t *data_start, std::size_t bytes, Hooks hooks = {})
+      : hooks(std::move(hooks)), data_pointer(data_start), data_end(data_start + bytes) {};
+
+  template<class ... Types>
+  void operator()(Types &... args) {
+    (unpack_field(std::forward<Types &>(args)), ...);
+  }
+
+  template<class ... Types>
+  void process(Types &... args) {
+    (unpack_field(std::forward<Types &>(args)), ...);
+  }
+
+  // Unpacks obj as a whole message, the counterpart of BasicPacker::pack_object
+  template<class UnpackableObject>
+  void unpack_object(UnpackableObject &obj) {
+    auto message_start = data_pointer;
+    allocated = 0;
+    if constexpr (Hooks::enabled) {
+      hooks.begin_message();
+    }
+    if constexpr (detail::has_msgpack_fields<UnpackableObject>::value) {
+      unpack_field_map(obj);
+    } else {
+      obj.pack(*this);
+    }
+    if constexpr (Hooks::enabled) {
+      // The values are walked again from their headers rather than reported from every decoding path
+      auto bytes = std::size_t(data_pointer - message_start);
+      detail::report_values(message_start, bytes, hooks);
+      hooks.end_message(bytes, ec);
+    }
+  }
+
+  void set_data(const uint8_t *pointer, std::size_t size) {
+    data_pointer = pointer;
+    data_end = data_pointer + size;
+  }
+
+  // Bytes not consumed yet
+  std::size_t remaining() const {
+    return std::size_t(data_end - data_pointer);
+  }
+
+  std::error_code ec{};
+  Hooks hooks{};
+  UnpackLimits limits{};
+
+  // Decoded values that use polymorphic allocators, but can't get one from the container they go into, allocate
+  // from here. nullptr leaves them on the default resource.
+  std::pmr::memory_resource *memory_resource = nullptr;
+
+ private:
+  const uint8_t *data_pointer;
+  const uint8_t *data_end;
+
+  // Containers around the current position and bytes allocated in this message, for checking the limits
+  std::size_t depth = 0;
+  std::size_t allocated = 0;
+
+  // Checks a container header against the limits before its elements are decoded, charging bytes_per_element for
+  // each of them to the allocation budget. False, with ec set, if it must not be decoded. Every successful call is
+  // matched by leave().
+  bool enter(std::size_t size, std::size_t bytes_per_element) {
+    if constexpr (BoundsChecked) {
+      if (ec) {
+        return false;
+      } else if (depth >= limits.max_depth) {
+        ec = UnpackerError::DepthLimitExceeded;
+        return false;
+      } else if (size > limits.max_container_size) {
+        ec = UnpackerError::ContainerTooLarge;
+        return false;
+      } else if (!charge(size, bytes_per_element)) {
+        return false;
+      }
+      ++depth;
+    }
+    return true;
+  }
+
+  void leave() {
+    if constexpr (BoundsChecked) {
+      --depth;
+    }
+  }
+
+  // Checks the length of a string or binary value, charging it to the allocation budget when it's copied
+  bool admit_string(std::size_t size, bool copied) {
+    if constexpr (BoundsChecked) {
+      if (size > limits.max_string_size) {
+        ec = UnpackerError::StringTooLarge;
+        return false;
+      }
+      return !copied || charge(size, 1);
+    }
+    return true;
+  }
+
+  bool charge(std::size_t count, std::size_t bytes_per_element) {
+    if (bytes_per_element != 0 && count > (limits.max_allocation - allocated) / bytes_per_element) {
+      ec = UnpackerError::AllocationLimitExceeded;
+      return false;
+    }
+    allocated += count * bytes_per_element;
+    return true;
+  }
+
+  // How many of size elements, each packed in at least min_packed_size bytes, to reserve room for up front. The
+  // reservation never takes more bytes than are left in the input, so a forged size can't force a huge allocation;
+  // the container grows past it as elements actually arrive.
+  template<class ValueType>
+  std::size_t reserve_count(std::size_t size, std::size_t min_packed_size) const {
+    auto bytes_left = std::size_t(data_end - data_pointer);
+    return std::min(size, bytes_left / std::max(sizeof(ValueType), min_packed_size));
+  }
+
+  // Element of a container with allocator, given that allocator, or memory_resource if it only takes a polymorphic one
+  template<class T, class Alloc>
+  T make_element(const Alloc &allocator) const {
+    if constexpr (std::uses_allocator_v<T, Alloc>) {
+      return detail::make_using_allocator<T>(allocator);
+    } else if constexpr (std::uses_allocator_v<T, std::pmr::polymorphic_allocator<std::byte>>) {
+      if (memory_resource != nullptr) {
+        return detail::make_using_allocator<T>(std::pmr::polymorphic_allocator<std::byte>{memory_resource});
+      }
+      return T{};
+    } else {
+      return T{};
+    }
+  }
+
+  // Decodes one field of an object with msgpack_fields
+  struct FieldThunk {
+    void *field;
+    void (*unpack)(BasicUnpacker &unpacker, void *field);
+  };
+
+  // While an object with msgpack_fields runs its pack member, its fields are collected here instead of decoded
+  FieldThunk *field_thunks = nullptr;
+  std::size_t thunk_count = 0;
+  std::size_t thunk_capacity = 0;
+
+  template<class T>
+  void unpack_field(T &value) {
+    if (field_thunks == nullptr) {
+      unpack_type(value);
+    } else if (thunk_count < thunk_capacity) {
+      field_thunks[thunk_count++] = FieldThunk{&value, [](BasicUnpacker &unpacker, void *field) {
+        unpacker.unpack_type(*static_cast<T *>(field));
+      }};
+    }
+  }
+
+  template<class T>
+  void unpack_field_map(T &object) {
+    using Table = detail::FieldTable<T>;
+    auto thunks = std::array<FieldThunk, Table::count>{};
+    auto outer_thunks = std::exchange(field_thunks, thunks.data());
+    auto outer_count = std::exchange(thunk_count, 0);
+    auto outer_capacity = std::exchange(thunk_capacity, Table::count);
+    object.pack(*this);
+    auto collected = thunk_count;
+    field_thunks = outer_thunks;
+    thunk_count = outer_count;
+    thunk_capacity = outer_capacity;
+
+    auto map_size = unpack_map_header();
+    if (!enter(map_size, 0)) {
+      return;
+    }
+    for (auto i = std::size_t{0}; i < map_size && !ec; ++i) {
+      auto index = Table::count;
+      auto format = safe_data();
+      if ((format >= 0xa0 && format <= 0xbf) || format == str8 || format == str16 || format == str32) {
+        auto key = std::string_view{};
+        unpack_type(key);
+        index = Table::find(key);
+      } else {
+        skip_value();
+      }
+      if (index < collected) {
+        thunks[index].unpack(*this, thunks[index].field);
+      } else {
+        skip_value(); // Fields this version of T doesn't know about
+      }
+    }
+    leave();
+  }
+
+  void skip_value() {
+    if (data_pointer == data_end) {
+      ec = UnpackerError::OutOfRange;
+      return;
+    }
+    data_pointer += detail::skip_values(data_pointer, std::size_t(data_end - data_pointer), 1, ec);
+  }
+
+  uint8_t safe_data() {
+    if constexpr (!BoundsChecked)
+      return *data_pointer;
+    if (data_pointer < data_end)
+      return *data_pointer;
+    ec = UnpackerError::OutOfRange;
+    return 0;
+  }
+
+  void safe_increment(int64_t bytes = 1) {
+    if (!BoundsChecked || data_end - data_pointer >= bytes) {
+      data_pointer += bytes;
+    } else {
+      data_pointer = data_end;
+      ec = UnpackerError::OutOfRange;
+    }
+  }
+
+  template<std::size_t N>
+  detail::uint_t<N> read_be() {
+    if (BoundsChecked && data_end - data_pointer < std::ptrdiff_t(N)) {
+      data_pointer = data_end;
+      ec = UnpackerError::OutOfRange;
+      return 0;
+    }
+    auto value = detail::load_be<N>(data_pointer);
+    data_pointer += N;
+    return value;
+  }
+
+  // Whether size more bytes are left to read
+  bool available(std::size_t size) const {
+    return !BoundsChecked || std::size_t(data_end - data_pointer) >= size;
+  }
+
+  template<class T>
+  void unpack_type(T &value) {
+    if constexpr(is_map<T>::value) {
+      unpack_map(value);
+    } else if constexpr (is_container<T>::value) {
+      unpack_array(value);
+    } else if constexpr (is_stdarray<T>::value) {
+      unpack_stdarray(value);
+    } else if constexpr (has_ext_type<T>::value) {
+      unpack_ext(value);
+    } else if constexpr (detail::has_msgpack_fields<T>::value) {
+      unpack_field_map(value);
+    } else if (safe_data() != bin8 && safe_data() != bin16 && safe_data() != bin32) {
+      // Nested objects are inline arrays of their fields, unless they were packed with PackerOptions::nested_as_bin
+      auto format = safe_data();
+      if (ec) {
+        return;
+      } else if ((format & 0xf0) != 0x90 && format != array16 && format != array32) {
+        ec = UnpackerError::InvalidFormat;
+        return;
+      } else if (unpack_array_header() != field_count(value)) {
+        ec = UnpackerError::FieldCountMismatch;
+        return;
+      } else if (!enter(0, 0)) {
+        return;
+      }
+      auto outer_thunks = std::exchange(field_thunks, nullptr);
+      value.pack(*this);
+      field_thunks = outer_thunks;
+      leave();
+    } else {
+      // Decode the bin payload in place, then step the parent over it
+      auto bin_size = unpack_bin_header();
+      if (available(bin_size)) {
+        if (!enter(0, 0)) {
+          return;
+        }
+        auto recursive_unpacker = BasicUnpacker{data_pointer, bin_size};
+        recursive_unpacker.memory_resource = memory_resource;
+        recursive_unpacker.limits = limits;
+        recursive_unpacker.depth = depth;
+        recursive_unpacker.allocated = allocated;
+        value.pack(recursive_unpacker);
+        allocated = recursive_unpacker.allocated;
+        if (recursive_unpacker.ec) {
+          ec = recursive_unpacker.ec;
+        }
+        leave();
+        safe_increment(bin_size);
+      } else {
+        ec = UnpackerError::OutOfRange;
+      }
+    }
+  }
+
+  void unpack_type(int8_t &value);
+  void unpack_type(int16_t &value);
+  void unpack_type(int32_t &value);
+  void unpack_type(int64_t &value);
+  void unpack_type(uint8_t &value);
+  void unpack_type(uint16_t &value);
+  void unpack_type(uint32_t &value);
+  void unpack_type(uint64_t &value);
+  void unpack_type(std::nullptr_t &value);
+  void unpack_type(bool &value);
+  void unpack_type(float &value);
+  void unpack_type(double &value);
+  void unpack_type(std::string_view &value);
+  void unpack_type(bin_view &value);
+
+  template<class Traits, class Alloc>
+  void unpack_type(std::basic_string<char, Traits, Alloc> &value);
+
+  template<class Alloc>
+  void unpack_type(std::vector<uint8_t, Alloc> &value);
+
+  std::size_t unpack_array_header() {
+    std::size_t array_size = 0;
+    if (safe_data() == array32) {
+      safe_increment();
+      array_size = read_be<4>();
+    } else if (safe_data() == array16) {
+      safe_increment();
+      array_size = read_be<2>();
+    } else {
+      array_size = safe_data() & 0b00001111;
+      safe_increment();
+    }
+    return array_size;
+  }
+
+  std::size_t unpack_str_header() {
+    std::size_t str_size = 0;
+    if (safe_data() == str32) {
+      safe_increment();
+      str_size = read_be<4>();
+    } else if (safe_data() == str16) {
+      safe_increment();
+      str_size = read_be<2>();
+    } else if (safe_data() == str8) {
+      safe_increment();
+      str_size = read_be<1>();
+    } else {
+      str_size = safe_data() & 0b00011111;
+      safe_increment();
+    }
+    return str_size;
+  }
+
+  std::size_t unpack_bin_header() {
+    std::size_t bin_size = 0;
+    if (safe_data() == bin32) {
+      safe_increment();
+      bin_size = read_be<4>();
+    } else if (safe_data() == bin16) {
+      safe_increment();
+      bin_size = read_be<2>();
+    } else {
+      safe_increment();
+      bin_size = read_be<1>();
+    }
+    return bin_size;
+  }
+
+  std::size_t unpack_ext_header(int8_t &type) {
+    std::size_t ext_size = 0;
+    switch (safe_data()) {
+      case fixext1:
+        ext_size = 1;
+        safe_increment();
+        break;
+      case fixext2:
+        ext_size = 2;
+        safe_increment();
+        break;
+      case fixext4:
+        ext_size = 4;
+        safe_increment();
+        break;
+      case fixext8:
+        ext_size = 8;
+        safe_increment();
+        break;
+      case fixext16:
+        ext_size = 16;
+        safe_increment();
+        break;
+      case ext8:
+        safe_increment();
+        ext_size = read_be<1>();
+        break;
+      case ext16:
+        safe_increment();
+        ext_size = read_be<2>();
+        break;
+      case ext32:
+        safe_increment();
+        ext_size = read_be<4>();
+        break;
+      default:
+        ec = UnpackerError::ExtensionMismatch;
+        return 0;
+    }
+    type = int8_t(safe_data());
+    safe_increment();
+    return ext_size;
+  }
+
+  template<class T>
+  void unpack_ext(T &value) {
+    if constexpr (detail::is_time_point<T>::value) {
+      auto format = safe_data();
+      if (format != ext8 && format != ext16 && format != ext32 && (format < fixext1 || format > fixext16)) {
+        // cppack 1.0 packed time points as their raw count
+        auto count = typename T::rep{};
+        unpack_type(count);
+        value = T(typename T::duration(count));
+        return;
+      }
+    }
+    auto type = int8_t{0};
+    auto ext_size = unpack_ext_header(type);
+    if (ec) {
+      return;
+    }
+    if (!available(ext_size)) {
+      ec = UnpackerError::OutOfRange;
+      return;
+    }
+    if (type != ext_type<T>::id || !ext_type<T>::unpack(data_pointer, ext_size, value)) {
+      ec = UnpackerError::ExtensionMismatch;
+    }
+    safe_increment(ext_size);
+  }
+
+  template<class T>
+  void unpack_array(T &array) {
+    using ValueType = typename T::value_type;
+    auto array_size = unpack_array_header();
+    if (!enter(array_size, sizeof(ValueType))) {
+      return;
+    }
+    if constexpr (detail::is_number_array<T>::value) {
+      // Decode in chunks that take no more bytes than the input has left, or than already decoded, so a forged size
+      // can't allocate much more than the data that actually arrives
+      auto offset = array.size();
+      auto decoded = std::size_t{0};
+      while (decoded < array_size && !ec) {
+        auto chunk = std::min(array_size - decoded,
+                              std::max({reserve_count<ValueType>(array_size - decoded, 1), decoded, std::size_t{1}}));
+        array.resize(offset + decoded + chunk);
+        decoded += unpack_numbers(array.data() + offset + decoded, chunk);
+      }
+      array.resize(offset + decoded);
+      if (decoded < array_size) {
+        ec = UnpackerError::OutOfRange;
+      }
+    } else {
+      if constexpr (detail::has_reserve<T>::value) {
+        array.reserve(array.size() + reserve_count<ValueType>(array_size, 1));
+      }
+      for (auto i = std::size_t{0}; i < array_size; ++i) {
+        auto val = make_element<ValueType>(array.get_allocator());
+        unpack_type(val);
+        if (ec) {
+          break;
+        }
+        array.insert(array.end(), std::move(val));
+      }
+    }
+    leave();
+  }
+
+  template<class T>
+  void unpack_stdarray(T &array) {
+    using ValueType = typename T::value_type;
+    auto array_size = unpack_array_header();
+    if (!enter(array_size, 0)) {
+      return;
+    }
+    auto count = std::min(array_size, array.size());
+    if constexpr (detail::is_number<ValueType>::value) {
+      unpack_numbers(array.data(), count);
+    } else {
+      for (auto i = std::size_t{0}; i < count; ++i) {
+        unpack_type(array[i]);
+      }
+    }
+    for (auto i = count; i < array_size && !ec; ++i) { // Drop elements that don't fit
+      auto val = make_element<ValueType>(std::allocator<ValueType>{});
+      unpack_type(val);
+    }
+    leave();
+  }
+
+  // Decodes up to count numbers into out and returns how many were decoded before running out of data
+  template<class T>
+  std::size_t unpack_numbers(T *out, std::size_t count) {
+    auto i = std::size_t{0};
+    while (i < count && !ec) {
+      if (data_pointer == data_end) {
+        ec = UnpackerError::OutOfRange;
+        break;
+      }
+      auto run = detail::decode_number_run(data_pointer, std::size_t(data_end - data_pointer), out + i, count - i);
+      if (run.count == 0) {
+        unpack_type(out[i]);
+        if (ec) {
+          break;
+        }
+        ++i;
+      } else {
+        data_pointer += run.bytes;
+        i += run.count;
+      }
+    }
+    return i;
+  }
+
+  std::size_t unpack_map_header() {
+    std::size_t map_size = 0;
+    if (safe_data() == map32) {
+      safe_increment();
+      map_size = read_be<4>();
+    } else if (safe_data() == map16) {
+      safe_increment();
+      map_size = read_be<2>();
+    } else {
+      map_size = safe_data() & 0b00001111;
+      safe_increment();
+    }
+    return map_size;
+  }
+
+  template<class T>
+  void unpack_map(T &map) {
+    using KeyType = typename T::key_type;
+    using MappedType = typename T::mapped_type;
+    auto map_size = unpack_map_header();
+    if (!enter(map_size, sizeof(KeyType) + sizeof(MappedType))) {
+      return;
+    }
+    if constexpr (detail::has_reserve<T>::value) {
+      map.reserve(map.size() + reserve_count<typename T::value_type>(map_size, 2));
+    }
+    for (auto i = std::size_t{0}; i < map_size; ++i) {
+      auto key = make_element<KeyType>(map.get_allocator());
+      auto value = make_element<MappedType>(map.get_allocator());
+      unpack_type(key);
+      unpack_type(value);
+      if (ec) {
+        break;
+      }
+      map.insert_or_assign(map.end(), std::move(key), std::move(value));
+    }
+    leave();
+  }
+};
+
+using Unpacker = BasicUnpacker<>;
+
+// Decodes without any bounds checks. Only for input that passed validate<T>() for the type it is unpacked into,
+// anything else can read past the end of the buffer.
+using UncheckedUnpacker = BasicUnpacker<false>;
+
+template<bool BoundsChecked, class Hooks>
+inline
+void BasicUnpacker<BoundsChecked, Hooks>::unpack_type(int8_t &value) {
+  if (safe_data() == int8) {
+    safe_increment();
+    value = int8_t(read_be<1>());
+  } else {
+    value = int8_t(safe_data());
+    safe_increment();
+  }
+}
+
+template<bool BoundsChecked, class Hooks>
+inline
+void BasicUnpacker<BoundsChecked, Hooks>::unpack_type(int16_t &value) {
+  if (safe_data() == int16) {
+    safe_increment();
+    value = int16_t(read_be<2>());
+  } else {
+    int8_t val;
+    unpack_type(val);
+    value = val;
+  }
+}
+
+template<bool BoundsChecked, class Hooks>
+inline
+void BasicUnpacker<BoundsChecked, Hooks>::unpack_type(int32_t &value) {
+  if (safe_data() == int32) {
+    safe_increment();
+    value = int32_t(read_be<4>());
+  } else {
+    int16_t val;
+    unpack_type(val);
+    value = val;
+  }
+}
+
+template<bool BoundsChecked, class Hooks>
+inline
+void BasicUnpacker<BoundsChecked, Hooks>::unpack_type(int64_t &value) {
+  if (safe_data() == int64) {
+    safe_increment();
+    value = int64_t(read_be<8>());
+  } else {
+    int32_t val;
+    unpack_type(val);
+    value = val;
+  }
+}
+
+template<bool BoundsChecked, class Hooks>
+inline
+void BasicUnpacker<BoundsChecked, Hooks>::unpack_type(uint8_t &value) {
+  if (safe_data() == uint8) {
+    safe_increment();
+    value = read_be<1>();
+  } else {
     value = safe_data();
     safe_increment();
   }
-}
-
-template<>
-inline
-void Unpacker::unpack_type(uint64_t &value) {
-  if (safe_data() == uint64) {
-    safe_increment();
-    for (auto i = sizeof(uint64_t); i > 0; --i) {
-      value += uint64_t(safe_data()) << 8 * (i - 1);
-      safe_increment();
-    }
-  } else if (safe_data() == uint32) {
-    safe_increment();
-    for (auto i = sizeof(uint32_t); i > 0; --i) {
-      value += uint64_t(safe_data()) << 8 * (i - 1);
-      safe_increment();
-    }
-    data_pointer++;
-  } else if (safe_data() == uint16) {
-    safe_increment();
-    for (auto i = sizeof(uint16_t); i > 0; --i) {
-      value += uint64_t(safe_data()) << 8 * (i - 1);
-      safe_increment();
+}
+
+template<bool BoundsChecked, class Hooks>
+inline
+void BasicUnpacker<BoundsChecked, Hooks>::unpack_type(uint16_t &value) {
+  if (safe_data() == uint16) {
+    safe_increment();
+    value = read_be<2>();
+  } else {
+    uint8_t val;
+    unpack_type(val);
+    value = val;
+  }
+}
+
+template<bool BoundsChecked, class Hooks>
+inline
+void BasicUnpacker<BoundsChecked, Hooks>::unpack_type(uint32_t &value) {
+  if (safe_data() == uint32) {
+    safe_increment();
+    value = read_be<4>();
+  } else {
+    uint16_t val;
+    unpack_type(val);
+    value = val;
+  }
+}
+
+template<bool BoundsChecked, class Hooks>
+inline
+void BasicUnpacker<BoundsChecked, Hooks>::unpack_type(uint64_t &value) {
+  if (safe_data() == uint64) {
+    safe_increment();
+    value = read_be<8>();
+  } else {
+    uint32_t val;
+    unpack_type(val);
+    value = val;
+  }
+}
+
+template<bool BoundsChecked, class Hooks>
+inline
+void BasicUnpacker<BoundsChecked, Hooks>::unpack_type(std::nullptr_t &/*value*/) {
+  safe_increment();
+}
+
+template<bool BoundsChecked, class Hooks>
+inline
+void BasicUnpacker<BoundsChecked, Hooks>::unpack_type(bool &value) {
+  value = safe_data() != 0xc2;
+  safe_increment();
+}
+
+template<bool BoundsChecked, class Hooks>
+inline
+void BasicUnpacker<BoundsChecked, Hooks>::unpack_type(double &value) {
+  if (safe_data() == float64) {
+    safe_increment();
+    auto data = read_be<8>();
+    std::memcpy(&value, &data, sizeof(value));
+  } else if (safe_data() == float32) {
+    float val = 0;
+    unpack_type(val);
+    value = val;
+  } else {
+    if (safe_data() == int8 || safe_data() == int16 || safe_data() == int32 || safe_data() == int64
+        || safe_data() >= 0xe0) {
+      int64_t val = 0;
+      unpack_type(val);
+      value = double(val);
+    } else {
+      uint64_t val = 0;
+      unpack_type(val);
+      value = double(val);
+    }
+  }
+}
+
+template<bool BoundsChecked, class Hooks>
+inline
+void BasicUnpacker<BoundsChecked, Hooks>::unpack_type(float &value) {
+  if (safe_data() == float32) {
+    safe_increment();
+    auto data = read_be<4>();
+    std::memcpy(&value, &data, sizeof(value));
+  } else if (safe_data() == float64) {
+    double val = 0;
+    unpack_type(val);
+    value = float(val);
+  } else {
+    if (safe_data() == int8 || safe_data() == int16 || safe_data() == int32 || safe_data() == int64
+        || safe_data() >= 0xe0) {
+      int64_t val = 0;
+      unpack_type(val);
+      value = float(val);
+    } else {
+      uint64_t val = 0;
+      unpack_type(val);
+      value = float(val);
+    }
+  }
+}
+
+template<bool BoundsChecked, class Hooks>
+template<class Traits, class Alloc>
+inline
+void BasicUnpacker<BoundsChecked, Hooks>::unpack_type(std::basic_string<char, Traits, Alloc> &value) {
+  auto str_size = unpack_str_header();
+  if (!admit_string(str_size, true)) {
+    return;
+  }
+  if (available(str_size)) {
+    value.assign(reinterpret_cast<const char *>(data_pointer), str_size); // Keeps the string's allocator
+    safe_increment(str_size);
+  } else {
+    ec = UnpackerError::OutOfRange;
+  }
+}
+
+template<bool BoundsChecked, class Hooks>
+template<class Alloc>
+inline
+void BasicUnpacker<BoundsChecked, Hooks>::unpack_type(std::vector<uint8_t, Alloc> &value) {
+  auto bin_size = unpack_bin_header();
+  if (!admit_string(bin_size, true)) {
+    return;
+  }
+  if (available(bin_size)) {
+    value.assign(data_pointer, data_pointer + bin_size);
+    safe_increment(bin_size);
+  } else {
+    ec = UnpackerError::OutOfRange;
+  }
+}
+
+template<bool BoundsChecked, class Hooks>
+inline
+void BasicUnpacker<BoundsChecked, Hooks>::unpack_type(std::string_view &value) {
+  auto str_size = unpack_str_header();
+  if (!admit_string(str_size, false)) {
+    return;
+  }
+  if (available(str_size)) {
+    value = std::string_view{reinterpret_cast<const char *>(data_pointer), str_size};
+    safe_increment(str_size);
+  } else {
+    ec = UnpackerError::OutOfRange;
+  }
+}
+
+template<bool BoundsChecked, class Hooks>
+inline
+void BasicUnpacker<BoundsChecked, Hooks>::unpack_type(bin_view &value) {
+  auto bin_size = unpack_bin_header();
+  if (!admit_string(bin_size, false)) {
+    return;
+  }
+  if (available(bin_size)) {
+    value = bin_view{data_pointer, bin_size};
+    safe_increment(bin_size);
+  } else {
+    ec = UnpackerError::OutOfRange;
+  }
+}
+
+// Exact number of bytes obj packs into, found by running its pack member without writing anything
+template<class PackableObject>
+std::size_t packed_size(PackableObject &&obj, PackerOptions options = {}) {
+  auto packer = BasicPacker<CountingSink>{CountingSink{}, options};
+  packer.pack_object(obj);
+  return packer.sink().size();
+}
+
+template<class PackableObject>
+std::vector<uint8_t> pack(PackableObject &obj) {
+  auto buffer = std::vector<uint8_t>{};
+  buffer.reserve(packed_size(obj)); // Measuring first is cheaper than growing the vector step by step
+  auto packer = BasicPacker<VectorRefSink>{VectorRefSink{buffer}};
+  packer.pack_object(obj);
+  return buffer;
+}
+
+template<class PackableObject>
+std::vector<uint8_t> pack(PackableObject &&obj) {
+  auto buffer = std::vector<uint8_t>{};
+  buffer.reserve(packed_size(obj)); // Measuring first is cheaper than growing the vector step by step
+  auto packer = BasicPacker<VectorRefSink>{VectorRefSink{buffer}};
+  packer.pack_object(obj);
+  return buffer;
+}
+
+// Per thread free list of packing buffers for pack_pooled. Buffers keep their capacity when they come back and are
+// handed out reserved for the sizes recently packed on the thread, so steady traffic stops allocating once the pool
+// is warm. Buffers far larger than recent messages are freed instead of kept, so one huge message doesn't pin its
+// memory for the life of the thread.
+class BufferPool {
+ public:
+  static constexpr std::size_t max_buffers = 8;
+
+  BufferPool(const BufferPool &) = delete;
+
+  BufferPool &operator=(const BufferPool &) = delete;
+
+  ~BufferPool() {
+    alive = false;
+  }
+
+  // The calling thread's pool, nullptr while the thread is shutting down and the pool is gone
+  static BufferPool *local() {
+    thread_local BufferPool pool;
+    return alive ? &pool : nullptr;
+  }
+
+  // An empty buffer with room for a typical recent message
+  std::vector<uint8_t> acquire() {
+    auto buffer = std::vector<uint8_t>{};
+    if (!buffers.empty()) {
+      buffer = std::move(buffers.back());
+      buffers.pop_back();
+      buffer.clear();
+    }
+    buffer.reserve(recent_size);
+    return buffer;
+  }
+
+  void release(std::vector<uint8_t> &&buffer) {
+    if (buffers.size() < max_buffers && buffer.capacity() <= std::max(recent_size * 4, min_capacity)) {
+      buffers.push_back(std::move(buffer));
+    }
+  }
+
+  // Moves the size estimate towards a message just packed, quickly up and slowly down
+  void record(std::size_t size) {
+    recent_size = size > recent_size ? size : recent_size - (recent_size - size) / 16;
+  }
+
+  // Buffers waiting to be reused
+  std::size_t size() const {
+    return buffers.size();
+  }
+
+ private:
+  // Capacity that is always worth keeping, however small recent messages were
+  static constexpr std::size_t min_capacity = 4096;
+
+  inline static thread_local bool alive = false;
+
+  std::vector<std::vector<uint8_t>> buffers{};
+  std::size_t recent_size = 0;
+
+  BufferPool() {
+    alive = true;
+    buffers.reserve(max_buffers);
+  }
+};
+
+// Packed message in a buffer borrowed from a BufferPool. The buffer goes back to the pool of the thread that destroys
+// the handle, unless it was moved out with release().
+class PooledBuffer {
+ public:
+  PooledBuffer() = default;
+
+  explicit PooledBuffer(std::vector<uint8_t> &&buffer) : buffer(std::move(buffer)) {};
+
+  PooledBuffer(PooledBuffer &&other) noexcept : buffer(std::move(other.buffer)) {
+    other.buffer.clear();
+  };
+
+  PooledBuffer &operator=(PooledBuffer &&other) noexcept {
+    if (this != &other) {
+      give_back();
+      buffer = std::move(other.buffer);
+      other.buffer.clear();
+    }
+    return *this;
+  }
+
+  PooledBuffer(const PooledBuffer &) = delete;
+
+  PooledBuffer &operator=(const PooledBuffer &) = delete;
+
+  ~PooledBuffer() {
+    give_back();
+  }
+
+  const uint8_t *data() const {
+    return buffer.data();
+  }
+
+  std::size_t size() const {
+    return buffer.size();
+  }
+
+  const uint8_t *begin() const {
+    return buffer.data();
+  }
+
+  const uint8_t *end() const {
+    return buffer.data() + buffer.size();
+  }
+
+  const uint8_t &operator[](std::size_t i) const {
+    return buffer[i];
+  }
+
+  const std::vector<uint8_t> &vector() const {
+    return buffer;
+  }
+
+  // Takes the buffer out for good, without copying it
+  std::vector<uint8_t> release() {
+    return std::move(buffer);
+  }
+
+ private:
+  std::vector<uint8_t> buffer{};
+
+  void give_back() {
+    if (buffer.capacity() > 0) {
+      if (auto pool = BufferPool::local()) {
+        pool->release(std::move(buffer));
+      }
+    }
+  }
+};
+
+// Packs obj into a buffer from the calling thread's BufferPool. Unlike pack(obj) it skips measuring the object first
+// and reuses the capacity of earlier messages, so a thread packing messages of similar sizes doesn't allocate.
+template<class PackableObject>
+PooledBuffer pack_pooled(PackableObject &&obj, PackerOptions options = {}) {
+  auto pool = BufferPool::local();
+  auto buffer = pool != nullptr ? pool->acquire() : std::vector<uint8_t>{};
+  auto packer = BasicPacker<VectorRefSink>{VectorRefSink{buffer}, options};
+  packer.pack_object(obj);
+  if (pool != nullptr) {
+    pool->record(buffer.size());
+  }
+  return PooledBuffer{std::move(buffer)};
+}
+
+template<std::size_t N>
+struct FixedBuffer {
+  std::array<uint8_t, N> bytes{};
+  std::size_t size = 0;
+  std::error_code ec{};
+};
+
+// Packs a type with a max_packed_size into a buffer on the stack, without touching the heap
+template<class PackableObject>
+FixedBuffer<max_packed_size_v<std::decay_t<PackableObject>>> pack_fixed(PackableObject &&obj) {
+  auto buffer = FixedBuffer<max_packed_size_v<std::decay_t<PackableObject>>>{};
+  auto packer = BasicPacker<SpanSink>{SpanSink{buffer.bytes.data(), buffer.bytes.size()}};
+  packer.pack_object(obj);
+  buffer.size = packer.sink().size();
+  buffer.ec = packer.ec;
+  return buffer;
+}
+
+template<class PackableObject>
+void pack(PackableObject &&obj, std::vector<uint8_t> &buffer) {
+  auto packer = BasicPacker<VectorRefSink>{VectorRefSink{buffer}};
+  packer.pack_object(obj);
+}
+
+template<class PackableObject>
+std::size_t pack(PackableObject &&obj, uint8_t *data_start, const std::size_t size, std::error_code &ec) {
+  auto packer = BasicPacker<SpanSink>{SpanSink{data_start, size}};
+  packer.pack_object(obj);
+  ec = packer.ec;
+  return packer.sink().size();
+}
+
+template<class PackableObject, class OutputIt,
+    std::enable_if_t<!std::is_base_of_v<std::ostream, std::decay_t<OutputIt>>, int> = 0>
+OutputIt pack(PackableObject &&obj, OutputIt out) {
+  auto packer = BasicPacker<IteratorSink<OutputIt>>{IteratorSink<OutputIt>{out}};
+  packer.pack_object(obj);
+  return packer.sink().iterator();
+}
+
+template<class PackableObject>
+std::error_code pack(PackableObject &&obj, std::ostream &stream) {
+  auto packer = BasicPacker<OstreamSink>{OstreamSink{stream}};
+  packer.pack_object(obj);
+  if (!packer.ec && !packer.sink().flush()) {
+    packer.ec = packer.sink().error();
+  }
+  return packer.ec;
+}
+
+// Appends every object in objects to buffer back to back, with one packer for the whole batch. offsets receives where
+// each object starts in buffer. The batch is measured with packed_size first, so buffer grows at most once.
+template<class Range>
+void pack_many(Range &&objects, std::vector<uint8_t> &buffer, std::vector<std::size_t> &offsets) {
+  auto count = std::size_t{0};
+  auto size = std::size_t{0};
+  for (auto &obj : objects) {
+    ++count;
+    size += packed_size(obj);
+  }
+  offsets.reserve(offsets.size() + count);
+  buffer.reserve(buffer.size() + size);
+  auto packer = BasicPacker<VectorRefSink>{VectorRefSink{buffer}};
+  for (auto &obj : objects) {
+    offsets.push_back(buffer.size());
+    packer.pack_object(obj);
+  }
+}
+
+template<class Range>
+std::vector<std::size_t> pack_many(Range &&objects, std::vector<uint8_t> &buffer) {
+  auto offsets = std::vector<std::size_t>{};
+  pack_many(objects, buffer, offsets);
+  return offsets;
+}
+
+template<class UnpackableObject>
+UnpackableObject unpack(const uint8_t *data_start, const std::size_t size, std::error_code &ec) {
+  auto obj = UnpackableObject{};
+  auto unpacker = Unpacker(data_start, size);
+  unpacker.unpack_object(obj);
+  ec = unpacker.ec;
+  return obj;
+}
+
+// Decodes into an object that allocates from resource, for types built from a polymorphic allocator such as the
+// std::pmr containers and strings. Releasing a monotonic_buffer_resource afterwards frees the whole message at once.
+template<class UnpackableObject>
+UnpackableObject unpack(const uint8_t *data_start, const std::size_t size, std::pmr::memory_resource *resource,
+                        std::error_code &ec) {
+  auto obj = detail::make_using_allocator<UnpackableObject>(std::pmr::polymorphic_allocator<std::byte>{resource});
+  auto unpacker = Unpacker(data_start, size);
+  unpacker.memory_resource = resource;
+  unpacker.unpack_object(obj);
+  ec = unpacker.ec;
+  return obj;
+}
+
+template<class UnpackableObject>
+UnpackableObject unpack(const std::vector<uint8_t> &data, std::pmr::memory_resource *resource, std::error_code &ec) {
+  return unpack<UnpackableObject>(data.data(), data.size(), resource, ec);
+}
+
+// Also reports how many bytes the object took up, i.e. where the next message in data_start starts
+template<class UnpackableObject>
+UnpackableObject unpack(const uint8_t *data_start, const std::size_t size, std::error_code &ec,
+                        std::size_t &consumed) {
+  auto obj = UnpackableObject{};
+  auto unpacker = Unpacker(data_start, size);
+  unpacker.unpack_object(obj);
+  ec = unpacker.ec;
+  consumed = size - unpacker.remaining();
+  return obj;
+}
+
+// Decodes untrusted data, rejecting it as soon as a header breaks one of the limits
+template<class UnpackableObject>
+UnpackableObject unpack(const uint8_t *data_start, const std::size_t size, const UnpackLimits &limits,
+                        std::error_code &ec) {
+  auto obj = UnpackableObject{};
+  auto unpacker = Unpacker(data_start, size);
+  unpacker.limits = limits;
+  unpacker.unpack_object(obj);
+  ec = unpacker.ec;
+  return obj;
+}
+
+template<class UnpackableObject>
+UnpackableObject unpack(const std::vector<uint8_t> &data, const UnpackLimits &limits, std::error_code &ec) {
+  return unpack<UnpackableObject>(data.data(), data.size(), limits, ec);
+}
+
+template<class UnpackableObject>
+UnpackableObject unpack(const uint8_t *data_start, const std::size_t size) {
+  std::error_code ec{};
+  return unpack<UnpackableObject>(data_start, size, ec);
+}
+
+template<class UnpackableObject>
+UnpackableObject unpack(const std::vector<uint8_t> &data, std::error_code &ec) {
+  return unpack<UnpackableObject>(data.data(), data.size(), ec);
+}
+
+template<class UnpackableObject>
+UnpackableObject unpack(const std::vector<uint8_t> &data) {
+  std::error_code ec;
+  return unpack<UnpackableObject>(data.data(), data.size(), ec);
+}
+
+// Checks in one pass that data holds nothing but complete, well formed values nested at most max_depth containers
+// deep. This only checks the structure, not that the values fit the types they will be decoded into, so it is no
+// guarantee that UncheckedUnpacker stays inside the buffer; see validate<T>() for that.
+inline std::error_code validate(const uint8_t *data, std::size_t size, std::size_t max_depth = 64) {
+  std::error_code ec{};
+  auto position = std::size_t{0};
+  while (position < size && !ec) {
+    position += detail::validate_values(data + position, size - position, 1, max_depth, ec);
+  }
+  return ec;
+}
+
+inline std::error_code validate(const std::vector<uint8_t> &data, std::size_t max_depth = 64) {
+  return validate(data.data(), data.size(), max_depth);
+}
+
+// Checks that data decodes as an UnpackableObject by running the checked Unpacker over it and discarding the result.
+// Decoding is deterministic, so data that passes takes exactly the same reads when unpack_unchecked decodes it into the
+// same type later, as often as needed.
+template<class UnpackableObject>
+std::error_code validate(const uint8_t *data_start, const std::size_t size) {
+  auto obj = UnpackableObject{};
+  auto unpacker = Unpacker(data_start, size);
+  unpacker.unpack_object(obj);
+  return unpacker.ec;
+}
+
+template<class UnpackableObject>
+std::error_code validate(const std::vector<uint8_t> &data) {
+  return validate<UnpackableObject>(data.data(), data.size());
+}
+
+// Unpacks data that has already been checked by validate<UnpackableObject>() without checking bounds again
+template<class UnpackableObject>
+UnpackableObject unpack_unchecked(const uint8_t *data_start, const std::size_t size) {
+  auto obj = UnpackableObject{};
+  auto unpacker = UncheckedUnpacker(data_start, size);
+  unpacker.unpack_object(obj);
+  return obj;
+}
+
+// Appends the back to back objects in data_start to objects. The records are counted from their headers first, so
+// objects grows by a single allocation. Complete objects before an error are kept.
+template<class UnpackableObject>
+std::error_code unpack_many(const uint8_t *data_start, const std::size_t size, std::vector<UnpackableObject> &objects) {
+  auto prototype = UnpackableObject{};
+  auto fields = message_values(prototype);
+  if (fields == 0) {
+    return {};
+  }
+  std::error_code ec{};
+  auto count = std::size_t{0};
+  for (auto position = std::size_t{0}; position < size && !ec; ++count) {
+    position += detail::skip_values(data_start + position, size - position, fields, ec);
+  }
+  if (ec) {
+    --count; // The last record is incomplete
+  }
+  objects.reserve(objects.size() + count);
+  auto unpacker = Unpacker(data_start, size);
+  for (auto i = std::size_t{0}; i < count; ++i) {
+    objects.emplace_back();
+    unpacker.unpack_object(objects.back());
+    if (unpacker.ec) {
+      objects.pop_back(); // Only partly decoded, e.g. a record that doesn't match UnpackableObject
+      return unpacker.ec;
     }
-  } else if (safe_data() == uint8) {
-    safe_increment();
-    value = safe_data();
-    safe_increment();
-  } else {
-    value = safe_data();
-    safe_increment();
   }
+  return ec;
 }
 
-template<>
-inline
-void Unpacker::unpack_type(std::nullptr_t &/*value*/) {
-  safe_increment();
+template<class UnpackableObject>
+std::error_code unpack_many(const std::vector<uint8_t> &data, std::vector<UnpackableObject> &objects) {
+  return unpack_many(data.data(), data.size(), objects);
 }
 
-template<>
-inline
-void Unpacker::unpack_type(bool &value) {
-  value = safe_data() != 0xc2;
-  safe_increment();
+template<class UnpackableObject>
+std::vector<UnpackableObject> unpack_many(const std::vector<uint8_t> &data, std::error_code &ec) {
+  auto objects = std::vector<UnpackableObject>{};
+  ec = unpack_many(data.data(), data.size(), objects);
+  return objects;
 }
 
-template<>
-inline
-void Unpacker::unpack_type(float &value) {
-  if (safe_data() == float32) {
-    safe_increment();
-    uint32_t data = 0;
-    for (auto i = sizeof(uint32_t); i > 0; --i) {
-      data += safe_data() << 8 * (i - 1);
-      safe_increment();
+// Push style decoder for messages that arrive in pieces, e.g. from a socket. Feed it chunks of any size and take
+// each message out with next() as soon as its last byte has arrived. Every byte is scanned once, and only the
+// message in flight stays buffered. Views unpacked from a message point into the internal buffer and are only
+// valid until the next call to feed().
+template<class UnpackableObject>
+class StreamUnpacker {
+ public:
+  StreamUnpacker() : pending_values(fields_per_message()) {};
+
+  void feed(const uint8_t *data, std::size_t size) {
+    if (message_start > 0) {
+      buffer.erase(buffer.begin(), buffer.begin() + std::ptrdiff_t(message_start));
+      scan_position -= message_start;
+      message_start = 0;
     }
-    auto bits = std::bitset<32>(data);
-    auto mantissa = 1.0f;
-    for (auto i = 23U; i > 0; --i) {
-      if (bits[i - 1]) {
-        mantissa += 1.0f / (1 << (24 - i));
-      }
+    buffer.insert(buffer.end(), data, data + size);
+  }
+
+  void feed(const std::vector<uint8_t> &data) {
+    feed(data.data(), data.size());
+  }
+
+  // Unpacks the next complete message into obj, false if it hasn't fully arrived yet
+  bool next(UnpackableObject &obj) {
+    if (ec || !scan()) {
+      return false;
     }
-    if (bits[31]) {
-      mantissa *= -1;
+    auto unpacker = Unpacker{buffer.data() + message_start, scan_position - message_start};
+    unpacker.limits = limits;
+    unpacker.unpack_object(obj);
+    ec = unpacker.ec;
+    message_start = scan_position;
+    pending_values = fields_per_message();
+    return !ec;
+  }
+
+  // Bytes held for messages that haven't been taken out yet
+  std::size_t buffered() const {
+    return buffer.size() - message_start;
+  }
+
+  std::error_code ec{};
+  UnpackLimits limits{};
+
+ private:
+  std::vector<uint8_t> buffer;
+  std::size_t message_start = 0;
+  std::size_t scan_position = 0;
+  std::size_t pending_values;
+  std::size_t pending_payload = 0;
+
+  static std::size_t fields_per_message() {
+    auto obj = UnpackableObject{};
+    return message_values(obj);
+  }
+
+  // Walks value headers from where the last call stopped, true once the current message is complete
+  bool scan() {
+    while (true) {
+      auto available = buffer.size() - scan_position;
+      if (pending_payload > 0) {
+        auto skipped = std::min(pending_payload, available);
+        scan_position += skipped;
+        pending_payload -= skipped;
+        if (pending_payload > 0) {
+          return false;
+        }
+        available -= skipped;
+      }
+      if (pending_values == 0) {
+        return true;
+      }
+      if (available == 0) {
+        return false;
+      }
+      auto header_size = detail::header_size(buffer[scan_position]);
+      if (header_size == 0) {
+        ec = UnpackerError::InvalidFormat;
+        return false;
+      }
+      if (available < header_size) {
+        return false;
+      }
+      auto header = detail::read_value_header(buffer.data() + scan_position);
+      // Refuse hostile lengths before buffering up to them
+      auto kind = detail::format_layouts[buffer[scan_position]].kind;
+      if (kind == detail::payload_length && header.payload_size > limits.max_string_size) {
+        ec = UnpackerError::StringTooLarge;
+        return false;
+      } else if (header.child_count / (kind == detail::entry_length ? 2 : 1) > limits.max_container_size) {
+        ec = UnpackerError::ContainerTooLarge;
+        return false;
+      }
+      scan_position += header.header_size;
+      pending_values += header.child_count - 1;
+      pending_payload = header.payload_size;
     }
-    uint8_t exponent = 0;
-    for (auto i = 0U; i < 8; ++i) {
-      exponent += bits[i + 23] << i;
+  }
+};
+// Reads a buffer of back to back messages, such as a mapped file, one record at a time. Views in the records point
+// into the buffer.
+template<class Record>
+class RecordReader {
+ public:
+  RecordReader(const uint8_t *data_start, std::size_t size) : data_start(data_start), size(size) {};
+
+  // Unpacks the next record, false at the end of the data or on error
+  bool next(Record &record) {
+    if (done()) {
+      return false;
     }
-    exponent -= 127;
-    value = ldexp(mantissa, exponent);
-  } else {
-    if (safe_data() == int8 || safe_data() == int16 || safe_data() == int32 || safe_data() == int64) {
-      int64_t val = 0;
-      unpack_type(val);
-      value = float(val);
-    } else {
-      uint64_t val = 0;
-      unpack_type(val);
-      value = float(val);
+    auto consumed = std::size_t{0};
+    record = unpack<Record>(data_start + position, size - position, ec, consumed);
+    position += consumed;
+    return !ec;
+  }
+
+  // Hands out the next record's encoded bytes without decoding them
+  bool next(bin_view &raw) {
+    if (done()) {
+      return false;
     }
+    auto consumed = detail::skip_values(data_start + position, size - position, fields_per_record(), ec);
+    raw = bin_view{data_start + position, consumed};
+    position += consumed;
+    return !ec;
+  }
+
+  bool done() const {
+    return position == size || ec;
+  }
+
+  // Bytes consumed so far, i.e. the offset of the next record
+  std::size_t offset() const {
+    return position;
+  }
+
+  void seek(std::size_t offset) {
+    position = std::min(offset, size);
+    ec.clear();
+  }
+
+  std::error_code ec{};
+
+ private:
+  const uint8_t *data_start;
+  std::size_t size;
+  std::size_t position = 0;
+
+  static std::size_t fields_per_record() {
+    auto record = Record{};
+    return message_values(record);
+  }
+};
+enum class ValueType : uint8_t {
+  Invalid,
+  Nil,
+  Boolean,
+  Integer,
+  Float,
+  String,
+  Binary,
+  Array,
+  Map,
+  Extension
+};
+
+namespace detail {
+inline ValueType value_type(uint8_t format) {
+  if (header_size(format) == 0) {
+    return ValueType::Invalid;
+  }
+  if (format <= 0x7f || format >= 0xe0 || (format >= uint8 && format <= int64)) {
+    return ValueType::Integer;
+  } else if (format <= 0x8f || format == map16 || format == map32) {
+    return ValueType::Map;
+  } else if (format <= 0x9f || format == array16 || format == array32) {
+    return ValueType::Array;
+  } else if (format <= 0xbf || (format >= str8 && format <= str32)) {
+    return ValueType::String;
   }
+  switch (format) {
+    case nil:
+      return ValueType::Nil;
+    case false_bool:
+    case true_bool:
+      return ValueType::Boolean;
+    case bin8:
+    case bin16:
+    case bin32:
+      return ValueType::Binary;
+    case float32:
+    case float64:
+      return ValueType::Float;
+    default:
+      return ValueType::Extension;
+  }
+}
 }
 
-template<>
-inline
-void Unpacker::unpack_type(double &value) {
-  if (safe_data() == float64) {
-    safe_increment();
-    uint64_t data = 0;
-    for (auto i = sizeof(uint64_t); i > 0; --i) {
-      data += uint64_t(safe_data()) << 8 * (i - 1);
-      safe_increment();
+// Read only walk over packed data that doesn't decode anything it isn't asked for. A cursor sits on one value at a
+// time: type() and size() describe it from its header, get<T>() decodes it and skip() steps over it, nested values
+// included, without allocating. enter() gives a cursor over the elements of an array, or the keys and values of a map.
+class Cursor {
+ public:
+  Cursor(const uint8_t *data_start, std::size_t size)
+      : data_pointer(data_start), data_end(data_start + size), count(std::size_t(-1)) {};
+
+  ValueType type() const {
+    if (done()) {
+      return ValueType::Invalid;
     }
-    auto bits = std::bitset<64>(data);
-    auto mantissa = 1.0;
-    for (auto i = 52U; i > 0; --i) {
-      if (bits[i - 1]) {
-        mantissa += 1.0 / (uint64_t(1) << (53 - i));
-      }
+    return detail::value_type(*data_pointer);
+  }
+
+  // Elements of an array, entries of a map, bytes of a string, binary or extension value and 0 for anything else
+  std::size_t size() const {
+    auto type = this->type();
+    if (type == ValueType::Invalid || std::size_t(data_end - data_pointer) < detail::header_size(*data_pointer)) {
+      return 0;
     }
-    if (bits[63]) {
-      mantissa *= -1;
+    auto header = detail::read_value_header(data_pointer);
+    switch (type) {
+      case ValueType::Array:
+        return header.child_count;
+      case ValueType::Map:
+        return header.child_count / 2;
+      case ValueType::String:
+      case ValueType::Binary:
+        return header.payload_size;
+      case ValueType::Extension:
+        return header.payload_size - 1;
+      default:
+        return 0;
     }
-    uint16_t exponent = 0;
-    for (auto i = 0U; i < 11; ++i) {
-      exponent += bits[i + 52] << i;
+  }
+
+  // Steps over this many values, nested contents included, using only their headers
+  bool skip(std::size_t values = 1) {
+    if (ec || values > count) {
+      ec = UnpackerError::OutOfRange;
+      return false;
     }
-    exponent -= 1023;
-    value = ldexp(mantissa, exponent);
-  } else {
-    if (safe_data() == int8 || safe_data() == int16 || safe_data() == int32 || safe_data() == int64) {
-      int64_t val = 0;
-      unpack_type(val);
-      value = float(val);
-    } else {
-      uint64_t val = 0;
-      unpack_type(val);
-      value = float(val);
+    data_pointer += detail::skip_values(data_pointer, std::size_t(data_end - data_pointer), values, ec);
+    if (count != std::size_t(-1)) {
+      count -= values;
     }
+    return !ec;
   }
-}
 
-template<>
-inline
-void Unpacker::unpack_type(std::string &value) {
-  std::size_t str_size = 0;
-  if (safe_data() == str32) {
-    safe_increment();
-    for (auto i = sizeof(uint32_t); i > 0; --i) {
-      str_size += uint32_t(safe_data()) << 8 * (i - 1);
-      safe_increment();
+  // Moves to the following value, false if there is none
+  bool next() {
+    return skip() && !done();
+  }
+
+  // Cursor over the contents of the current array or map, empty for other values. The current position is kept, so
+  // call skip() to move past the whole container afterwards.
+  Cursor enter() const {
+    auto type = this->type();
+    if ((type != ValueType::Array && type != ValueType::Map)
+        || std::size_t(data_end - data_pointer) < detail::header_size(*data_pointer)) {
+      return Cursor{data_end, data_end, 0};
     }
-  } else if (safe_data() == str16) {
-    safe_increment();
-    for (auto i = sizeof(uint16_t); i > 0; --i) {
-      str_size += uint16_t(safe_data()) << 8 * (i - 1);
-      safe_increment();
+    auto header = detail::read_value_header(data_pointer);
+    return Cursor{data_pointer + header.header_size, data_end, header.child_count};
+  }
+
+  // Within an entered map, moves to the value stored under key, false if there is no such key
+  bool find(std::string_view key) {
+    while (!done()) {
+      if (type() == ValueType::String && get<std::string_view>() == key) {
+        return skip();
+      }
+      if (!skip(2)) {
+        return false;
+      }
     }
-  } else if (safe_data() == str8) {
-    safe_increment();
-    for (auto i = sizeof(uint8_t); i > 0; --i) {
-      str_size += uint8_t(safe_data()) << 8 * (i - 1);
-      safe_increment();
+    return false;
+  }
+
+  // Decodes the current value without moving, T should fit type()
+  template<class T>
+  T get() {
+    auto value = T{};
+    if (done()) {
+      ec = UnpackerError::OutOfRange;
+      return value;
     }
-  } else {
-    str_size = safe_data() & 0b00011111;
-    safe_increment();
+    auto unpacker = Unpacker{data_pointer, std::size_t(data_end - data_pointer)};
+    unpacker.process(value);
+    if (unpacker.ec) {
+      ec = unpacker.ec;
+    }
+    return value;
   }
-  if (data_pointer + str_size <= data_end) {
-    value = std::string{data_pointer, data_pointer + str_size};
-    safe_increment(str_size);
-  } else {
-    ec = UnpackerError::OutOfRange;
+
+  // No values left at this level, or an error stopped the walk
+  bool done() const {
+    return count == 0 || data_pointer == data_end || ec;
   }
+
+  // Current position, e.g. for handing the bytes of a value on as they are
+  const uint8_t *position() const {
+    return data_pointer;
+  }
+
+  std::error_code ec{};
+
+ private:
+  const uint8_t *data_pointer;
+  const uint8_t *data_end;
+  std::size_t count;
+
+  Cursor(const uint8_t *data_pointer, const uint8_t *data_end, std::size_t count)
+      : data_pointer(data_pointer), data_end(data_end), count(count) {};
+};
+
+class Document;
+
+namespace detail {
+class DocumentBuilder;
 }
 
-template<>
-inline
-void Unpacker::unpack_type(std::vector<uint8_t> &value) {
-  std::size_t bin_size = 0;
-  if (safe_data() == bin32) {
-    safe_increment();
-    for (auto i = sizeof(uint32_t); i > 0; --i) {
-      bin_size += uint32_t(safe_data()) << 8 * (i - 1);
-      safe_increment();
-    }
-  } else if (safe_data() == bin16) {
-    safe_increment();
-    for (auto i = sizeof(uint16_t); i > 0; --i) {
-      bin_size += uint16_t(safe_data()) << 8 * (i - 1);
-      safe_increment();
+// One decoded value of any msgpack type, see Document. Strings, binary and extension data point into the packed bytes
+// (or the document's copy of them), arrays and maps point at their elements in the document's arena.
+class Object {
+ public:
+  ValueType type() const {
+    return kind;
+  }
+
+  bool is_nil() const {
+    return kind == ValueType::Nil;
+  }
+
+  bool as_bool() const {
+    return kind == ValueType::Boolean && boolean;
+  }
+
+  // 0 for anything but integers. Values outside the range of the requested type wrap, check is_negative() where
+  // that matters.
+  int64_t as_int64() const {
+    return kind == ValueType::Integer ? int64_t(integer) : 0;
+  }
+
+  uint64_t as_uint64() const {
+    return kind == ValueType::Integer ? integer : 0;
+  }
+
+  bool is_negative() const {
+    return kind == ValueType::Integer && negative;
+  }
+
+  // Floats, and integers converted to double
+  double as_double() const {
+    if (kind == ValueType::Integer) {
+      return negative ? double(int64_t(integer)) : double(integer);
     }
-  } else {
-    safe_increment();
-    for (auto i = sizeof(uint8_t); i > 0; --i) {
-      bin_size += uint8_t(safe_data()) << 8 * (i - 1);
-      safe_increment();
+    return kind == ValueType::Float ? real : 0.0;
+  }
+
+  std::string_view as_string() const {
+    return kind == ValueType::String ? std::string_view{reinterpret_cast<const char *>(bytes), length}
+                                     : std::string_view{};
+  }
+
+  // Bytes of a string, binary or extension value
+  const uint8_t *data() const {
+    return is_bytes() ? bytes : nullptr;
+  }
+
+  // Type id of an extension value
+  int8_t ext_type() const {
+    return ext;
+  }
+
+  // Elements of an array, entries of a map, bytes of a string, binary or extension value and 0 for anything else
+  std::size_t size() const {
+    return length;
+  }
+
+  // Element of an array, or nil past its end
+  const Object &operator[](std::size_t index) const {
+    return kind == ValueType::Array && index < length ? children[index] : nil_object();
+  }
+
+  // Key and value of a map entry
+  const Object &key(std::size_t index) const {
+    return kind == ValueType::Map && index < length ? children[2 * index] : nil_object();
+  }
+
+  const Object &value(std::size_t index) const {
+    return kind == ValueType::Map && index < length ? children[2 * index + 1] : nil_object();
+  }
+
+  // Value stored in a map under a string key, nullptr if there is none
+  const Object *find(std::string_view name) const {
+    if (kind == ValueType::Map) {
+      for (auto index = std::size_t{0}; index < length; ++index) {
+        if (children[2 * index].kind == ValueType::String && children[2 * index].as_string() == name) {
+          return &children[2 * index + 1];
+        }
+      }
     }
+    return nullptr;
   }
-  if (data_pointer + bin_size <= data_end) {
-    value = std::vector<uint8_t>{data_pointer, data_pointer + bin_size};
-    safe_increment(bin_size);
-  } else {
-    ec = UnpackerError::OutOfRange;
+
+ private:
+  friend class detail::DocumentBuilder;
+
+  ValueType kind{ValueType::Nil};
+  int8_t ext{};
+  bool negative{};
+  uint32_t length{};
+  union {
+    bool boolean;
+    uint64_t integer{};
+    double real;
+    const uint8_t *bytes;
+    const Object *children;
+  };
+
+  bool is_bytes() const {
+    return kind == ValueType::String || kind == ValueType::Binary || kind == ValueType::Extension;
   }
-}
 
-template<class PackableObject>
-std::vector<uint8_t> pack(PackableObject &obj) {
-  auto packer = Packer{};
-  obj.pack(packer);
-  return packer.vector();
-}
+  static const Object &nil_object() {
+    static const auto nil_value = Object{};
+    return nil_value;
+  }
+};
 
-template<class PackableObject>
-std::vector<uint8_t> pack(PackableObject &&obj) {
-  auto packer = Packer{};
-  obj.pack(packer);
-  return packer.vector();
-}
+// A decoded message whose schema isn't known at compile time. Every Object of the tree lives in one arena allocated
+// after a counting pass over the headers, and is freed with the document. By default strings and binary data are
+// views of the packed bytes, which then have to outlive the document; pass copy_bytes to unpack_document to have them
+// copied into the arena as well.
+class Document {
+ public:
+  Document() = default;
 
-template<class UnpackableObject>
-UnpackableObject unpack(const uint8_t *data_start, const std::size_t size, std::error_code &ec) {
-  auto obj = UnpackableObject{};
-  auto unpacker = Unpacker(data_start, size);
-  obj.pack(unpacker);
-  ec = unpacker.ec;
-  return obj;
-}
+  const Object &root() const {
+    return nodes != nullptr ? *nodes : empty;
+  }
+
+  // Objects in the tree, root included
+  std::size_t node_count() const {
+    return count;
+  }
 
-template<class UnpackableObject>
-UnpackableObject unpack(const uint8_t *data_start, const std::size_t size) {
   std::error_code ec{};
-  return unpack<UnpackableObject>(data_start, size, ec);
+
+ private:
+  friend class detail::DocumentBuilder;
+
+  std::unique_ptr<uint8_t[]> arena{};
+  Object *nodes{};
+  std::size_t count{};
+  Object empty{};
+};
+
+namespace detail {
+static_assert(std::is_trivially_destructible_v<Object>, "Objects in a Document arena are never destroyed");
+
+class DocumentBuilder {
+ public:
+  static Document build(const uint8_t *data, std::size_t size, bool copy_bytes, std::size_t max_depth) {
+    auto document = Document{};
+    validate_values(data, size, 1, max_depth, document.ec);
+    if (document.ec) {
+      return document;
+    }
+    auto byte_count = std::size_t{0};
+    document.count = count_nodes(data, copy_bytes ? &byte_count : nullptr);
+    document.arena.reset(new uint8_t[document.count * sizeof(Object) + byte_count]);
+    document.nodes = reinterpret_cast<Object *>(document.arena.get());
+    std::uninitialized_value_construct_n(document.nodes, document.count);
+    auto builder = DocumentBuilder{document.nodes + 1,
+                                   copy_bytes ? document.arena.get() + document.count * sizeof(Object) : nullptr};
+    builder.fill(data, *document.nodes);
+    return document;
+  }
+
+ private:
+  Object *next_node;
+  uint8_t *next_byte;
+
+  DocumentBuilder(Object *next_node, uint8_t *next_byte) : next_node(next_node), next_byte(next_byte) {};
+
+  // Objects in the first value of data, which has been validated, and the bytes its strings, binary and extension
+  // values hold
+  static std::size_t count_nodes(const uint8_t *data, std::size_t *byte_count) {
+    auto nodes = std::size_t{0};
+    for (auto pending = std::size_t{1}; pending > 0; --pending, ++nodes) {
+      auto header = read_value_header(data);
+      if (byte_count != nullptr && header.child_count == 0 && value_type(*data) != ValueType::Integer
+          && value_type(*data) != ValueType::Float) {
+        *byte_count += header.payload_size;
+      }
+      data += header.header_size + header.payload_size;
+      pending += header.child_count;
+    }
+    return nodes;
+  }
+
+  const uint8_t *view(const uint8_t *data, std::size_t size) {
+    if (next_byte == nullptr) {
+      return data;
+    }
+    auto copy = next_byte;
+    std::copy(data, data + size, copy);
+    next_byte += size;
+    return copy;
+  }
+
+  // Decodes the value at data into object, returns the data following it
+  const uint8_t *fill(const uint8_t *data, Object &object) {
+    auto header = read_value_header(data);
+    auto payload = data + header.header_size;
+    object.kind = value_type(*data);
+    switch (object.kind) {
+      case ValueType::Nil:
+        break;
+      case ValueType::Boolean:
+        object.boolean = *data == true_bool;
+        break;
+      case ValueType::Integer:
+        fill_integer(data, object);
+        break;
+      case ValueType::Float:
+        object.real = *data == float32 ? double(from_bits<float>(load_be<4>(payload)))
+                                       : from_bits<double>(load_be<8>(payload));
+        break;
+      case ValueType::String:
+      case ValueType::Binary:
+        object.length = uint32_t(header.payload_size);
+        object.bytes = view(payload, header.payload_size);
+        break;
+      case ValueType::Extension:
+        object.ext = int8_t(*payload);
+        object.length = uint32_t(header.payload_size - 1);
+        object.bytes = view(payload + 1, header.payload_size - 1);
+        break;
+      case ValueType::Array:
+      case ValueType::Map: {
+        auto children = next_node;
+        next_node += header.child_count;
+        object.length = uint32_t(object.kind == ValueType::Map ? header.child_count / 2 : header.child_count);
+        object.children = children;
+        data = payload;
+        for (auto index = std::size_t{0}; index < header.child_count; ++index) {
+          data = fill(data, children[index]);
+        }
+        return data;
+      }
+      case ValueType::Invalid:
+        break;
+    }
+    return payload + header.payload_size;
+  }
+
+  static void fill_integer(const uint8_t *data, Object &object) {
+    auto format = *data;
+    auto value = int64_t{};
+    if (format <= 0x7f) {
+      object.integer = format;
+      return;
+    } else if (format >= 0xe0) {
+      value = int8_t(format);
+    } else {
+      switch (format) {
+        case uint8:
+          object.integer = load_be<1>(data + 1);
+          return;
+        case uint16:
+          object.integer = load_be<2>(data + 1);
+          return;
+        case uint32:
+          object.integer = load_be<4>(data + 1);
+          return;
+        case uint64:
+          object.integer = load_be<8>(data + 1);
+          return;
+        case int8:
+          value = int8_t(load_be<1>(data + 1));
+          break;
+        case int16:
+          value = int16_t(load_be<2>(data + 1));
+          break;
+        case int32:
+          value = int32_t(load_be<4>(data + 1));
+          break;
+        default:
+          value = int64_t(load_be<8>(data + 1));
+          break;
+      }
+    }
+    object.integer = uint64_t(value);
+    object.negative = value < 0;
+  }
+};
 }
 
-template<class UnpackableObject>
-UnpackableObject unpack(const std::vector<uint8_t> &data, std::error_code &ec) {
-  return unpack<UnpackableObject>(data.data(), data.size(), ec);
+// Decodes the first value in data, whatever its type, into a Document. ec of the result is set if data doesn't start
+// with a complete, well formed value nested at most max_depth containers deep.
+inline Document unpack_document(const uint8_t *data, std::size_t size, bool copy_bytes = false,
+                                std::size_t max_depth = 64) {
+  return detail::DocumentBuilder::build(data, size, copy_bytes, max_depth);
 }
 
-template<class UnpackableObject>
-UnpackableObject unpack(const std::vector<uint8_t> &data) {
-  std::error_code ec;
-  return unpack<UnpackableObject>(data.data(), data.size(), ec);
+inline Document unpack_document(const std::vector<uint8_t> &data, bool copy_bytes = false,
+                                std::size_t max_depth = 64) {
+  return unpack_document(data.data(), data.size(), copy_bytes, max_depth);
 }
 }
 
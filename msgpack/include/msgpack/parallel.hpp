@@ -0,0 +1,74 @@
+#ifndef CPPACK_PARALLEL_HPP
+#define CPPACK_PARALLEL_HPP
+
+#include <future>
+#include <thread>
+
+#include "msgpack.hpp"
+
+namespace msgpack {
+// Packs a random access range of objects on up to threads threads and appends them to buffer in input order. Every
+// thread packs a contiguous shard into its own buffer and the shards are joined at the end, so the output is byte for
+// byte what pack_many would produce. Objects have to be safe to pack concurrently with each other.
+template<class Range>
+void pack_parallel(Range &&objects, std::vector<uint8_t> &buffer, std::vector<std::size_t> &offsets,
+                   std::size_t threads = std::thread::hardware_concurrency()) {
+  auto begin = std::begin(objects);
+  auto count = std::size_t(std::distance(begin, std::end(objects)));
+  // Tiny shards cost more in thread start up than they save
+  constexpr auto min_shard_size = std::size_t{1024};
+  threads = std::max(std::size_t{1}, std::min(threads, count / min_shard_size));
+  if (threads == 1) {
+    pack_many(objects, buffer, offsets);
+    return;
+  }
+
+  struct Shard {
+    std::vector<uint8_t> buffer;
+    std::vector<std::size_t> offsets;
+  };
+  auto shards = std::vector<Shard>(threads);
+  auto pack_shard = [&](std::size_t shard) {
+    auto first = begin + std::ptrdiff_t(count * shard / threads);
+    auto last = begin + std::ptrdiff_t(count * (shard + 1) / threads);
+    auto packer = BasicPacker<VectorRefSink>{VectorRefSink{shards[shard].buffer}};
+    shards[shard].offsets.reserve(std::size_t(last - first));
+    for (; first != last; ++first) {
+      shards[shard].offsets.push_back(shards[shard].buffer.size());
+      packer.pack_object(*first);
+    }
+  };
+  auto workers = std::vector<std::future<void>>{};
+  for (auto shard = std::size_t{1}; shard < threads; ++shard) {
+    workers.push_back(std::async(std::launch::async, pack_shard, shard));
+  }
+  pack_shard(0);
+  for (auto &worker : workers) {
+    worker.get();
+  }
+
+  auto total = std::size_t{0};
+  for (auto &shard : shards) {
+    total += shard.buffer.size();
+  }
+  buffer.reserve(buffer.size() + total);
+  offsets.reserve(offsets.size() + count);
+  for (auto &shard : shards) {
+    auto base = buffer.size();
+    for (auto offset : shard.offsets) {
+      offsets.push_back(base + offset);
+    }
+    buffer.insert(buffer.end(), shard.buffer.begin(), shard.buffer.end());
+  }
+}
+
+template<class Range>
+std::vector<std::size_t> pack_parallel(Range &&objects, std::vector<uint8_t> &buffer,
+                                       std::size_t threads = std::thread::hardware_concurrency()) {
+  auto offsets = std::vector<std::size_t>{};
+  pack_parallel(objects, buffer, offsets, threads);
+  return offsets;
+}
+}
+
+#endif //CPPACK_PARALLEL_HPP
@@ -0,0 +1,144 @@
+#ifndef CPPACK_POSIX_IO_HPP
+#define CPPACK_POSIX_IO_HPP
+
+#include <cerrno>
+#include <string>
+#include <utility>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "msgpack.hpp"
+
+namespace msgpack {
+class FdWriter {
+ public:
+  explicit FdWriter(int fd) : fd(fd) {};
+
+  bool write(const uint8_t *data, std::size_t size) {
+    while (size > 0) {
+      auto written = ::write(fd, data, size);
+      if (written < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        ec = std::error_code(errno, std::system_category());
+        return false;
+      }
+      data += written;
+      size -= std::size_t(written);
+    }
+    return true;
+  }
+
+  std::error_code error() const {
+    return ec;
+  }
+
+ private:
+  int fd;
+  std::error_code ec{};
+};
+
+// Packs into a file, pipe or socket through a fixed size buffer. The descriptor stays owned by the caller.
+class FdSink : public BufferedSink<FdWriter> {
+ public:
+  explicit FdSink(int fd, std::size_t capacity = default_capacity)
+      : BufferedSink<FdWriter>(FdWriter{fd}, capacity) {};
+};
+
+// Read only mapping of a whole file, for reading records with RecordReader without copying the file to the heap
+class MappedFile {
+ public:
+  MappedFile(const std::string &path, std::error_code &ec) {
+    auto fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      ec = std::error_code(errno, std::system_category());
+      return;
+    }
+    struct stat info{};
+    if (::fstat(fd, &info) != 0) {
+      ec = std::error_code(errno, std::system_category());
+    } else if (info.st_size > 0) {
+      auto mapping = ::mmap(nullptr, std::size_t(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+      if (mapping == MAP_FAILED) {
+        ec = std::error_code(errno, std::system_category());
+      } else {
+        data_start = static_cast<const uint8_t *>(mapping);
+        bytes = std::size_t(info.st_size);
+        advise(MADV_SEQUENTIAL);
+      }
+    }
+    ::close(fd);
+  }
+
+  MappedFile(const MappedFile &) = delete;
+
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  MappedFile(MappedFile &&other) noexcept
+      : data_start(std::exchange(other.data_start, nullptr)), bytes(std::exchange(other.bytes, 0)) {};
+
+  MappedFile &operator=(MappedFile &&other) noexcept {
+    std::swap(data_start, other.data_start);
+    std::swap(bytes, other.bytes);
+    return *this;
+  }
+
+  ~MappedFile() {
+    if (data_start != nullptr) {
+      ::munmap(const_cast<uint8_t *>(data_start), bytes);
+    }
+  }
+
+  const uint8_t *data() const {
+    return data_start;
+  }
+
+  std::size_t size() const {
+    return bytes;
+  }
+
+  // Passes an madvise hint (MADV_SEQUENTIAL, MADV_WILLNEED, MADV_DONTNEED, ...) for the pages covering
+  // [offset, offset + length). New mappings start out with MADV_SEQUENTIAL.
+  bool advise(int advice, std::size_t offset = 0, std::size_t length = std::size_t(-1)) {
+    if (data_start == nullptr || offset >= bytes) {
+      return false;
+    }
+    auto page_size = std::size_t(::sysconf(_SC_PAGESIZE));
+    auto start = offset - offset % page_size;
+    length = std::min(length, bytes - offset) + (offset - start);
+    return ::madvise(const_cast<uint8_t *>(data_start) + start, length, advice) == 0;
+  }
+
+  // Lets the kernel drop the pages before offset, e.g. the records a sequential scan has already read
+  bool release(std::size_t offset) {
+    auto page_size = std::size_t(::sysconf(_SC_PAGESIZE));
+    auto end = std::min(offset, bytes);
+    end -= end % page_size;
+    return end > 0 && ::madvise(const_cast<uint8_t *>(data_start), end, MADV_DONTNEED) == 0;
+  }
+
+  template<class Record>
+  RecordReader<Record> records() const {
+    return RecordReader<Record>{data_start, bytes};
+  }
+
+ private:
+  const uint8_t *data_start = nullptr;
+  std::size_t bytes = 0;
+};
+
+template<class PackableObject>
+std::error_code pack_to_fd(PackableObject &&obj, int fd) {
+  auto packer = BasicPacker<FdSink>{FdSink{fd}};
+  packer.pack_object(obj);
+  if (!packer.ec && !packer.sink().flush()) {
+    packer.ec = packer.sink().error();
+  }
+  return packer.ec;
+}
+}
+
+#endif //CPPACK_POSIX_IO_HPP
@@ -0,0 +1,101 @@
+#include <catch2/catch.hpp>
+
+#include <msgpack/msgpack.hpp>
+
+struct CursorInner {
+  std::map<std::string, int32_t> scores;
+  std::vector<double> samples;
+
+  template<class T>
+  void pack(T &pack) {
+    pack(scores, samples);
+  }
+};
+
+struct CursorExample {
+  std::string name;
+  std::vector<CursorInner> inner;
+  std::vector<uint8_t> blob;
+  bool flag;
+  uint64_t id;
+
+  template<class T>
+  void pack(T &pack) {
+    pack(name, inner, blob, flag, id);
+  }
+};
+
+TEST_CASE("Cursor describes and skips values") {
+  auto example = CursorExample{"cursor", {{{{"a", 1}, {"b", -2}}, {0.5, 1.5}}, {{}, {}}},
+                               std::vector<uint8_t>(300, 1), true, 0xffffffffff};
+  auto data = msgpack::pack(example);
+
+  auto cursor = msgpack::Cursor{data.data(), data.size()};
+  REQUIRE(cursor.type() == msgpack::ValueType::String);
+  REQUIRE(cursor.size() == 6);
+  REQUIRE(cursor.get<std::string_view>() == "cursor");
+  REQUIRE(cursor.next());
+  REQUIRE(cursor.type() == msgpack::ValueType::Array);
+  REQUIRE(cursor.size() == 2);
+
+  auto inner = cursor.enter();
+  REQUIRE(inner.type() == msgpack::ValueType::Array);
+  auto fields = inner.enter();
+  REQUIRE(fields.type() == msgpack::ValueType::Map);
+  REQUIRE(fields.size() == 2);
+  auto scores = fields.enter();
+  REQUIRE(scores.find("b"));
+  REQUIRE(scores.type() == msgpack::ValueType::Integer);
+  REQUIRE(scores.get<int32_t>() == -2);
+  REQUIRE(!scores.next());
+  REQUIRE(!fields.enter().find("c"));
+  REQUIRE(fields.next());
+  REQUIRE(fields.enter().get<double>() == 0.5);
+  REQUIRE(!fields.next());
+  REQUIRE(inner.next());
+  REQUIRE(inner.enter().enter().done());
+  REQUIRE(!inner.next());
+  REQUIRE(!inner.ec);
+
+  REQUIRE(cursor.next());
+  REQUIRE(cursor.type() == msgpack::ValueType::Binary);
+  REQUIRE(cursor.size() == 300);
+  REQUIRE(cursor.enter().done());
+  REQUIRE(cursor.skip(2));
+  REQUIRE(cursor.get<uint64_t>() == example.id);
+  REQUIRE(!cursor.next());
+  REQUIRE(cursor.done());
+  REQUIRE(!cursor.ec);
+
+  cursor = msgpack::Cursor{data.data(), data.size()};
+  REQUIRE(cursor.skip(3));
+  REQUIRE(cursor.type() == msgpack::ValueType::Boolean);
+  REQUIRE(cursor.get<bool>());
+}
+
+TEST_CASE("Cursor jumps to an array element") {
+  auto values = std::vector<std::string>{"zero", "one", "two", std::string(1000, '3'), "four"};
+  auto packer = msgpack::Packer{};
+  packer(values);
+  auto data = packer.vector();
+
+  auto elements = msgpack::Cursor{data.data(), data.size()}.enter();
+  REQUIRE(elements.skip(4));
+  REQUIRE(elements.get<std::string>() == "four");
+  REQUIRE(!elements.skip(2));
+  REQUIRE(elements.ec == msgpack::UnpackerError::OutOfRange);
+}
+
+TEST_CASE("Cursor reports broken data") {
+  auto data = std::vector<uint8_t>{0x92, 0xa5, 'a', 'b'};
+  auto cursor = msgpack::Cursor{data.data(), data.size()};
+  REQUIRE(cursor.size() == 2);
+  REQUIRE(!cursor.skip());
+  REQUIRE(cursor.ec == msgpack::UnpackerError::OutOfRange);
+
+  data = {0x91, 0xc1};
+  cursor = msgpack::Cursor{data.data(), data.size()};
+  REQUIRE(cursor.enter().type() == msgpack::ValueType::Invalid);
+  REQUIRE(!cursor.skip());
+  REQUIRE(cursor.ec == msgpack::UnpackerError::InvalidFormat);
+}
@@ -0,0 +1,84 @@
+#include <catch2/catch.hpp>
+
+#include <msgpack/msgpack.hpp>
+
+struct DocumentExample {
+  std::string name{"Jane"};
+  int32_t balance{-1200};
+  std::vector<double> samples{1.5, -2.25};
+  std::map<std::string, uint64_t> counts{{"a", 1}, {"b", 0xffffffffffffffff}};
+  std::vector<uint8_t> blob{1, 2, 3};
+  bool active{true};
+  std::chrono::system_clock::time_point created{std::chrono::seconds(1700000000)};
+
+  static constexpr std::array<std::string_view, 7> msgpack_fields{"name", "balance", "samples", "counts", "blob",
+                                                                   "active", "created"};
+
+  template<class T>
+  void pack(T &pack) {
+    pack(name, balance, samples, counts, blob, active, created);
+  }
+};
+
+TEST_CASE("Documents decode messages of any shape") {
+  auto object = DocumentExample{};
+  auto data = msgpack::pack(object);
+  auto document = msgpack::unpack_document(data);
+  REQUIRE(!document.ec);
+  // Root, 7 keys and values, 2 samples, 2 count entries
+  REQUIRE(document.node_count() == 1 + 14 + 2 + 4);
+
+  auto &root = document.root();
+  REQUIRE(root.type() == msgpack::ValueType::Map);
+  REQUIRE(root.size() == 7);
+  REQUIRE(root.key(0).as_string() == "name");
+  REQUIRE(root.value(0).as_string() == "Jane");
+  REQUIRE(root.find("balance")->as_int64() == -1200);
+  REQUIRE(root.find("balance")->is_negative());
+  REQUIRE(root.find("samples")->size() == 2);
+  REQUIRE((*root.find("samples"))[1].as_double() == -2.25);
+  REQUIRE((*root.find("samples"))[2].is_nil());
+  REQUIRE(root.find("counts")->find("b")->as_uint64() == 0xffffffffffffffff);
+  REQUIRE(!root.find("counts")->find("b")->is_negative());
+  REQUIRE(root.find("blob")->type() == msgpack::ValueType::Binary);
+  REQUIRE(std::vector<uint8_t>(root.find("blob")->data(), root.find("blob")->data() + 3) == object.blob);
+  REQUIRE(root.find("active")->as_bool());
+  REQUIRE(root.find("created")->type() == msgpack::ValueType::Extension);
+  REQUIRE(root.find("created")->ext_type() == -1);
+  REQUIRE(root.find("created")->size() == 4);
+  REQUIRE(root.find("missing") == nullptr);
+  REQUIRE(root.find("name")->data() >= data.data());
+  REQUIRE(root.find("name")->data() < data.data() + data.size());
+}
+
+TEST_CASE("Documents can own copies of their strings") {
+  auto data = msgpack::pack(DocumentExample{});
+  auto document = msgpack::unpack_document(data, true);
+  auto name = document.root().find("name")->as_string();
+  std::fill(data.begin(), data.end(), uint8_t{0});
+  data.clear();
+  data.shrink_to_fit();
+  REQUIRE(name == "Jane");
+  REQUIRE(document.root().find("blob")->data()[2] == 3);
+}
+
+TEST_CASE("Documents report malformed data") {
+  auto data = msgpack::pack(DocumentExample{});
+  data.pop_back();
+  auto document = msgpack::unpack_document(data);
+  REQUIRE(document.ec == msgpack::UnpackerError::OutOfRange);
+  REQUIRE(document.root().is_nil());
+  REQUIRE(document.node_count() == 0);
+
+  auto nested = std::vector<uint8_t>(100, 0x91);
+  nested.push_back(0xc0);
+  REQUIRE(msgpack::unpack_document(nested).ec == msgpack::UnpackerError::DepthLimitExceeded);
+  REQUIRE(!msgpack::unpack_document(nested, false, 100).ec);
+
+  auto scalars = std::vector<uint8_t>{0x93, 0xd0, 0x80, 0xcb, 0x40, 0x09, 0x21, 0xfb, 0x54, 0x44, 0x2d, 0x18, 0xc2};
+  auto values = msgpack::unpack_document(scalars);
+  REQUIRE(values.root()[0].as_int64() == -128);
+  REQUIRE(values.root()[1].as_double() == 3.141592653589793);
+  REQUIRE(values.root()[2].type() == msgpack::ValueType::Boolean);
+  REQUIRE(!values.root()[2].as_bool());
+}
@@ -23,4 +23,172 @@ TEST_CASE("Unpacking a short dataset safely fails") {
   REQUIRE(example.map != msgpack::unpack<ExampleError>(data, ec).map);
   REQUIRE(ec);
   REQUIRE(ec == msgpack::UnpackerError::OutOfRange);
-}
\ No newline at end of file
+}
+
+struct ExampleString {
+  std::string value;
+
+  template<class T>
+  void pack(T &pack) {
+    pack(value);
+  }
+};
+
+struct ExampleNestedError {
+  int first_member{};
+  ExampleError second_member{};
+
+  template<class T>
+  void pack(T &pack) {
+    pack(first_member, second_member);
+  }
+};
+
+TEST_CASE("Errors in bin wrapped nested objects reach the parent") {
+  auto data = std::vector<uint8_t>{0x01, 0xc4, 13, 0x82, 0xa7, 0x63, 0x6f, 0x6d, 0x70, 0x61, 0x63, 0x74, 0xc3, 0xa6,
+                                   0x73, 0x63};
+  std::error_code ec{};
+  auto unpacked = msgpack::unpack<ExampleNestedError>(data, ec);
+  REQUIRE(unpacked.first_member == 1);
+  REQUIRE(ec == msgpack::UnpackerError::OutOfRange);
+
+  data[2] = 40; // Bin size runs past the end of the buffer
+  ec.clear();
+  msgpack::unpack<ExampleNestedError>(data, ec);
+  REQUIRE(ec == msgpack::UnpackerError::OutOfRange);
+}
+
+TEST_CASE("Validating finds truncated, malformed and overly nested data") {
+  auto example = ExampleNestedError{7, {{{"compact", true}, {"schema", false}}}};
+  auto data = msgpack::pack(example);
+  REQUIRE(!msgpack::validate(data));
+  REQUIRE(msgpack::validate(data.data(), data.size(), 1) == msgpack::UnpackerError::DepthLimitExceeded);
+  REQUIRE(!msgpack::validate(data.data(), data.size(), 2));
+
+  for (auto size = std::size_t{2}; size < data.size(); ++size) { // data[0] is the whole first member
+    REQUIRE(msgpack::validate(data.data(), size) == msgpack::UnpackerError::OutOfRange);
+  }
+
+  data.back() = 0xc1;
+  REQUIRE(msgpack::validate(data) == msgpack::UnpackerError::InvalidFormat);
+
+  auto nested = std::vector<uint8_t>(100, 0x91);
+  nested.push_back(0xc0);
+  REQUIRE(msgpack::validate(nested) == msgpack::UnpackerError::DepthLimitExceeded);
+  REQUIRE(!msgpack::validate(nested.data(), nested.size(), 100));
+}
+
+TEST_CASE("Unchecked unpacking matches checked unpacking on valid data") {
+  auto example = ExampleNestedError{-300, {{{"compact", true}, {"schema", false}}}};
+  auto data = msgpack::pack(example);
+  REQUIRE(!msgpack::validate<ExampleNestedError>(data));
+  auto unchecked = msgpack::unpack_unchecked<ExampleNestedError>(data.data(), data.size());
+  REQUIRE(unchecked.first_member == example.first_member);
+  REQUIRE(unchecked.second_member.map == example.second_member.map);
+
+  // Well formed, but the array where a string is expected would be read as a string header
+  auto packer = msgpack::Packer{};
+  packer.process(std::vector<int>{1});
+  auto mismatched = packer.vector();
+  REQUIRE(!msgpack::validate(mismatched));
+  REQUIRE(msgpack::validate<ExampleString>(mismatched) == msgpack::UnpackerError::OutOfRange);
+}
+
+struct ExampleTree {
+  std::vector<ExampleTree> children;
+
+  template<class T>
+  void pack(T &pack) {
+    pack(children);
+  }
+};
+
+TEST_CASE("Limits reject hostile headers before decoding them") {
+  auto nested = std::vector<uint8_t>(200, 0x91);
+  nested.push_back(0x90);
+  std::error_code ec{};
+  msgpack::unpack<ExampleTree>(nested, ec);
+  REQUIRE(ec == msgpack::UnpackerError::DepthLimitExceeded);
+  auto deep = msgpack::UnpackLimits{};
+  deep.max_depth = 1000;
+  msgpack::unpack<ExampleTree>(nested, deep, ec);
+  REQUIRE(!ec);
+
+  auto limits = msgpack::UnpackLimits{};
+  limits.max_container_size = 1000;
+  limits.max_string_size = 1000;
+  limits.max_allocation = 1 << 20;
+
+  auto strings = std::vector<std::string>{};
+  auto unpacker = msgpack::Unpacker{};
+  unpacker.limits = limits;
+  auto forged_array = std::vector<uint8_t>{0xdd, 0x00, 0x01, 0x00, 0x00, 0xa1, 'a'};
+  unpacker.set_data(forged_array.data(), forged_array.size());
+  unpacker.process(strings);
+  REQUIRE(unpacker.ec == msgpack::UnpackerError::ContainerTooLarge);
+  REQUIRE(strings.capacity() == 0);
+
+  auto numbers = std::vector<uint64_t>{};
+  auto wide_array = std::vector<uint8_t>{0xdc, 0x03, 0xe8, 0x01};
+  unpacker.ec.clear();
+  unpacker.limits.max_allocation = 999 * sizeof(uint64_t);
+  unpacker.set_data(wide_array.data(), wide_array.size());
+  unpacker.process(numbers);
+  REQUIRE(unpacker.ec == msgpack::UnpackerError::AllocationLimitExceeded);
+  REQUIRE(numbers.empty());
+
+  auto long_string = std::vector<uint8_t>{0xdb, 0x00, 0x0f, 0x42, 0x40, 'a'};
+  auto string = std::string{};
+  unpacker.ec.clear();
+  unpacker.set_data(long_string.data(), long_string.size());
+  unpacker.process(string);
+  REQUIRE(unpacker.ec == msgpack::UnpackerError::StringTooLarge);
+
+  // Many strings that are each short enough still add up
+  auto many = std::vector<std::string>(100, std::string(100, 'x'));
+  auto packer = msgpack::Packer{};
+  packer.process(many);
+  unpacker.ec.clear();
+  unpacker.limits.max_allocation = 5000;
+  unpacker.set_data(packer.vector().data(), packer.vector().size());
+  strings.clear();
+  unpacker.process(strings);
+  REQUIRE(unpacker.ec == msgpack::UnpackerError::AllocationLimitExceeded);
+
+  auto stream = msgpack::StreamUnpacker<ExampleError>{};
+  stream.limits = limits;
+  stream.feed(std::vector<uint8_t>{0x81, 0xa1, 'k', 0xc6, 0x40, 0x00, 0x00, 0x00});
+  auto object = ExampleError{};
+  REQUIRE(!stream.next(object));
+  REQUIRE(stream.ec == msgpack::UnpackerError::StringTooLarge);
+}
+
+struct ExampleBig {
+  std::array<uint64_t, 512> words;
+
+  template<class T>
+  void pack(T &pack) {
+    pack(words);
+  }
+};
+
+TEST_CASE("Forged container sizes don't reserve more memory than the input holds") {
+  // The first element is one number short, so decoding fails before any element is added
+  auto data = std::vector<uint8_t>{0xdd, 0xff, 0xff, 0xff, 0xff, 0x91, 0xdc, 0x02, 0x00};
+  data.resize(data.size() + 511, 0x01);
+  auto bigs = std::vector<ExampleBig>{};
+  auto unpacker = msgpack::Unpacker{data.data(), data.size()};
+  unpacker.process(bigs);
+  REQUIRE(unpacker.ec == msgpack::UnpackerError::OutOfRange);
+  REQUIRE(bigs.capacity() * sizeof(ExampleBig) <= data.size());
+
+  auto forged_numbers = std::vector<uint8_t>{0xdd, 0xff, 0xff, 0xff, 0xff};
+  forged_numbers.resize(forged_numbers.size() + 100000, 0xcb); // float64 headers, nine bytes per element
+  auto doubles = std::vector<double>{};
+  unpacker.ec.clear();
+  unpacker.set_data(forged_numbers.data(), forged_numbers.size());
+  unpacker.process(doubles);
+  REQUIRE(unpacker.ec == msgpack::UnpackerError::OutOfRange);
+  REQUIRE(doubles.size() == 100000 / 9);
+  REQUIRE(doubles.capacity() * sizeof(double) <= forged_numbers.size());
+}
@@ -0,0 +1,119 @@
+#include <catch2/catch.hpp>
+
+#include <msgpack/msgpack.hpp>
+
+struct HookedInner {
+  std::map<std::string, int32_t> scores{{"a", 1}, {"b", -300}};
+  std::vector<uint8_t> blob = std::vector<uint8_t>(300, 7);
+
+  template<class T>
+  void pack(T &pack) {
+    pack(scores, blob);
+  }
+};
+
+struct HookedOuter {
+  std::string name{"outer"};
+  std::vector<HookedInner> inner{HookedInner{}, HookedInner{}};
+  std::vector<double> samples{1.5, 2.0, -3.25};
+  bool flag{true};
+  std::nullptr_t nothing{};
+
+  template<class T>
+  void pack(T &pack) {
+    pack(name, inner, samples, flag, nothing);
+  }
+};
+
+struct HookEvent {
+  uint8_t format;
+  std::size_t length;
+  std::size_t depth;
+
+  bool operator==(const HookEvent &other) const {
+    return format == other.format && length == other.length && depth == other.depth;
+  }
+};
+
+struct RecordingHooks : msgpack::NullHooks {
+  static constexpr bool enabled = true;
+
+  std::vector<HookEvent> events{};
+  std::size_t begun = 0;
+  std::size_t message_bytes = 0;
+
+  void begin_message() {
+    ++begun;
+  }
+
+  void value(uint8_t format, std::size_t length, std::size_t depth) {
+    events.push_back(HookEvent{format, length, depth});
+  }
+
+  void end_message(std::size_t bytes, const std::error_code &/*ec*/) {
+    message_bytes = bytes;
+  }
+};
+
+TEST_CASE("Hooks see every value packed and unpacked") {
+  auto object = HookedOuter{};
+  auto packer = msgpack::BasicPacker<msgpack::VectorSink, RecordingHooks>{};
+  packer.pack_object(object);
+  auto data = packer.vector();
+  REQUIRE(data == msgpack::pack(object));
+  REQUIRE(packer.hooks.begun == 1);
+  REQUIRE(packer.hooks.message_bytes == data.size());
+
+  auto &events = packer.hooks.events;
+  REQUIRE(events.size() == 2 + 2 * (2 + 4 + 1) + 4 + 2);
+  REQUIRE(events[0] == HookEvent{0xa5, 5, 0});
+  REQUIRE(events[1] == HookEvent{0x92, 2, 0});
+  REQUIRE(events[2] == HookEvent{0x92, 2, 1});
+  REQUIRE(events[3] == HookEvent{0x82, 2, 2});
+  REQUIRE(events[4] == HookEvent{0xa1, 1, 3});
+  REQUIRE(events[7] == HookEvent{msgpack::int16, 0, 3});
+  REQUIRE(events[8] == HookEvent{msgpack::bin16, 300, 2});
+  REQUIRE(events[16] == HookEvent{0x93, 3, 0});
+  REQUIRE(events[17] == HookEvent{msgpack::float64, 0, 1});
+  REQUIRE(events[18] == HookEvent{2, 0, 1});
+  REQUIRE(events.back() == HookEvent{msgpack::nil, 0, 0});
+
+  auto unpacker = msgpack::BasicUnpacker<true, RecordingHooks>{data.data(), data.size()};
+  auto unpacked = HookedOuter{"", {}, {}, false, nullptr};
+  unpacker.unpack_object(unpacked);
+  REQUIRE(!unpacker.ec);
+  REQUIRE(unpacker.hooks.begun == 1);
+  REQUIRE(unpacker.hooks.message_bytes == data.size());
+  REQUIRE(unpacker.hooks.events == events);
+}
+
+TEST_CASE("Stats hooks keep totals") {
+  auto object = HookedOuter{};
+  auto packer = msgpack::BasicPacker<msgpack::VectorSink, msgpack::StatsHooks>{};
+  packer.pack_object(object);
+  packer.pack_object(object);
+  auto &stats = packer.hooks;
+  REQUIRE(stats.messages == 2);
+  REQUIRE(stats.failed_messages == 0);
+  REQUIRE(stats.bytes == packer.vector().size());
+  REQUIRE(stats.count(0x90) == 2 * 4);
+  REQUIRE(stats.count(0x80) == 2 * 2);
+  REQUIRE(stats.count(0xa0) == 2 * 5);
+  REQUIRE(stats.count(0x00) == 2 * 3);
+  REQUIRE(stats.count(msgpack::bin16) == 2 * 2);
+  REQUIRE(stats.largest_container == 3);
+  REQUIRE(stats.largest_payload == 300);
+  REQUIRE(stats.max_depth == 3);
+  REQUIRE(stats.max_time >= std::chrono::nanoseconds{0});
+  REQUIRE(stats.total_time >= stats.max_time);
+
+  auto data = packer.vector();
+  data.resize(data.size() / 2 - 1);
+  auto unpacker = msgpack::BasicUnpacker<true, msgpack::StatsHooks>{data.data(), data.size()};
+  auto unpacked = HookedOuter{};
+  unpacker.unpack_object(unpacked);
+  REQUIRE(unpacker.ec);
+  REQUIRE(unpacker.hooks.messages == 1);
+  REQUIRE(unpacker.hooks.failed_messages == 1);
+  REQUIRE(unpacker.hooks.largest_payload == 300);
+}
@@ -32,4 +32,234 @@ TEST_CASE("Can serialize user objects") {
 
   REQUIRE(object.first_member == unpacked_object.first_member);
   REQUIRE(object.second_member.nested_value == unpacked_object.second_member.nested_value);
-}
\ No newline at end of file
+}
+
+TEST_CASE("Nested objects are packed inline as arrays") {
+  auto object = BaseObject{12345, {"NestedObject"}};
+  auto data = msgpack::pack(object);
+
+  auto expected = std::vector<uint8_t>{0xd1, 0x30, 0x39, 0b10010000 | 1, 0b10100000 | 12};
+  for (char c : std::string("NestedObject")) {
+    expected.emplace_back(uint8_t(c));
+  }
+  REQUIRE(data == expected);
+}
+
+struct WiderNestedObject {
+  std::string nested_value{};
+  int extra{};
+
+  template<class T>
+  void pack(T &pack) {
+    pack(nested_value, extra);
+  }
+};
+
+template<class Nested>
+struct TailObject {
+  int first_member{};
+  Nested second_member{};
+  int tail{};
+
+  template<class T>
+  void pack(T &pack) {
+    pack(first_member, second_member, tail);
+  }
+};
+
+TEST_CASE("Nested objects have to match the shape of the type") {
+  auto data = msgpack::pack(TailObject<WiderNestedObject>{1, {"inner", 9}, 2});
+  std::error_code ec{};
+  msgpack::unpack<TailObject<NestedObject>>(data, ec);
+  REQUIRE(ec == msgpack::UnpackerError::FieldCountMismatch);
+
+  auto nil = std::vector<uint8_t>{0x01, 0xc0, 0x02};
+  msgpack::unpack<TailObject<NestedObject>>(nil, ec);
+  REQUIRE(ec == msgpack::UnpackerError::InvalidFormat);
+
+  auto matching = msgpack::unpack<TailObject<WiderNestedObject>>(data, ec);
+  REQUIRE(!ec);
+  REQUIRE(matching.tail == 2);
+}
+
+TEST_CASE("Nested objects can be packed as bin for compatibility") {
+  auto object = BaseObject{12345, {"NestedObject"}};
+  auto packer = msgpack::Packer{msgpack::PackerOptions{true}};
+  object.pack(packer);
+
+  auto expected = std::vector<uint8_t>{0xd1, 0x30, 0x39, 0xc4, 13, 0b10100000 | 12};
+  for (char c : std::string("NestedObject")) {
+    expected.emplace_back(uint8_t(c));
+  }
+  REQUIRE(packer.vector() == expected);
+
+  auto unpacked_object = msgpack::unpack<BaseObject>(packer.vector());
+  REQUIRE(object.first_member == unpacked_object.first_member);
+  REQUIRE(object.second_member.nested_value == unpacked_object.second_member.nested_value);
+}
+
+struct DeepObject {
+  std::vector<BaseObject> children{};
+  std::map<std::string, std::vector<double>> series{};
+  std::string blob{};
+
+  template<class T>
+  void pack(T &pack) {
+    pack(children, series, blob);
+  }
+};
+
+TEST_CASE("Packed size matches the packed bytes") {
+  auto object = DeepObject{{{1, {"one"}}, {-70000, {std::string(300, 'x')}}},
+                           {{"a", {0.5, 1.0, 2.25}}, {"b", std::vector<double>(1000, 1e300)}},
+                           std::string(70000, 'y')};
+  REQUIRE(msgpack::packed_size(object) == msgpack::pack(object).size());
+  REQUIRE(msgpack::packed_size(BaseObject{}) == msgpack::pack(BaseObject{}).size());
+
+  for (auto options : {msgpack::PackerOptions{true, false, false}, msgpack::PackerOptions{false, true, true}}) {
+    auto packer = msgpack::Packer{options};
+    object.pack(packer);
+    REQUIRE(msgpack::packed_size(object, options) == packer.vector().size());
+  }
+
+  auto legacy = msgpack::Packer{msgpack::PackerOptions{true}};
+  object.pack(legacy);
+  auto unpacked = msgpack::unpack<DeepObject>(legacy.vector());
+  REQUIRE(unpacked.children[1].first_member == -70000);
+  REQUIRE(unpacked.children[1].second_member.nested_value == object.children[1].second_member.nested_value);
+  REQUIRE(unpacked.series == object.series);
+}
+
+struct NamedV1 {
+  std::string name{};
+  uint16_t age{};
+  std::vector<std::string> aliases{};
+  NestedObject nested{};
+
+  static constexpr std::array<std::string_view, 4> msgpack_fields{"name", "age", "aliases", "nested"};
+
+  template<class T>
+  void pack(T &pack) {
+    pack(name, age);
+    pack(aliases, nested);
+  }
+};
+
+struct NamedV2 {
+  std::map<std::string, double> scores{};
+  std::string name{};
+  NamedV1 previous{};
+  uint16_t age{};
+
+  static constexpr std::array<std::string_view, 4> msgpack_fields{"scores", "name", "previous", "age"};
+
+  template<class T>
+  void pack(T &pack) {
+    pack(scores, name, previous, age);
+  }
+};
+
+TEST_CASE("Objects with field names are packed as maps") {
+  auto object = NamedV1{"John", 22, {"Ripper"}, {"inner"}};
+  auto data = msgpack::pack(object);
+  auto expected = std::vector<uint8_t>{0x84, 0xa4, 'n', 'a', 'm', 'e', 0xa4, 'J', 'o', 'h', 'n',
+                                       0xa3, 'a', 'g', 'e', 22,
+                                       0xa7, 'a', 'l', 'i', 'a', 's', 'e', 's', 0x91, 0xa6, 'R', 'i', 'p', 'p', 'e', 'r',
+                                       0xa6, 'n', 'e', 's', 't', 'e', 'd', 0x91, 0xa5, 'i', 'n', 'n', 'e', 'r'};
+  REQUIRE(data == expected);
+  REQUIRE(msgpack::packed_size(object) == expected.size());
+
+  std::error_code ec{};
+  auto unpacked = msgpack::unpack<NamedV1>(data, ec);
+  REQUIRE(!ec);
+  REQUIRE(unpacked.name == object.name);
+  REQUIRE(unpacked.aliases == object.aliases);
+  REQUIRE(unpacked.nested.nested_value == "inner");
+}
+
+TEST_CASE("Objects with field names survive added, removed and reordered fields") {
+  auto newer = NamedV2{{{"x", 1.5}}, "Jane", {"Old", 30, {"a", "b"}, {"n"}}, 41};
+  auto data = msgpack::pack(newer);
+
+  std::error_code ec{};
+  auto older = msgpack::unpack<NamedV1>(data, ec);
+  REQUIRE(!ec);
+  REQUIRE(older.name == "Jane");
+  REQUIRE(older.age == 41);
+  REQUIRE(older.aliases.empty());
+
+  auto round_trip = msgpack::unpack<NamedV2>(msgpack::pack(older), ec);
+  REQUIRE(!ec);
+  REQUIRE(round_trip.name == "Jane");
+  REQUIRE(round_trip.age == 41);
+  REQUIRE(round_trip.scores.empty());
+
+  auto nested = msgpack::unpack<NamedV2>(data, ec);
+  REQUIRE(nested.previous.aliases == newer.previous.aliases);
+  REQUIRE(nested.previous.nested.nested_value == "n");
+
+  auto stream = msgpack::StreamUnpacker<NamedV2>{};
+  stream.feed(data);
+  stream.feed(data);
+  REQUIRE(stream.next(nested));
+  REQUIRE(stream.next(nested));
+  REQUIRE(!stream.next(nested));
+  REQUIRE(stream.buffered() == 0);
+
+  data[0] = 0x85; // Claims an entry that isn't there
+  msgpack::unpack<NamedV2>(data, ec);
+  REQUIRE(ec == msgpack::UnpackerError::OutOfRange);
+}
+
+struct NamedMismatch {
+  int a{};
+  int b{};
+
+  static constexpr std::array<std::string_view, 1> msgpack_fields{"a"};
+
+  template<class T>
+  void pack(T &pack) {
+    pack(a, b);
+  }
+};
+
+TEST_CASE("Field names have to match the packed fields") {
+  auto packer = msgpack::Packer{};
+  auto object = NamedMismatch{};
+  packer.pack_object(object);
+  REQUIRE(packer.ec == msgpack::PackerError::FieldCountMismatch);
+}
+
+struct NamedWide {
+  std::array<int, 100> values{};
+
+  static constexpr std::array<std::string_view, 100> msgpack_fields{
+      "field0", "field1", "field2", "field3", "field4", "field5", "field6", "field7", "field8", "field9", "field10",
+      "field11", "field12", "field13", "field14", "field15", "field16", "field17", "field18", "field19", "field20",
+      "field21", "field22", "field23", "field24", "field25", "field26", "field27", "field28", "field29", "field30",
+      "field31", "field32", "field33", "field34", "field35", "field36", "field37", "field38", "field39", "field40",
+      "field41", "field42", "field43", "field44", "field45", "field46", "field47", "field48", "field49", "field50",
+      "field51", "field52", "field53", "field54", "field55", "field56", "field57", "field58", "field59", "field60",
+      "field61", "field62", "field63", "field64", "field65", "field66", "field67", "field68", "field69", "field70",
+      "field71", "field72", "field73", "field74", "field75", "field76", "field77", "field78", "field79", "field80",
+      "field81", "field82", "field83", "field84", "field85", "field86", "field87", "field88", "field89", "field90",
+      "field91", "field92", "field93", "field94", "field95", "field96", "field97", "field98", "field99"};
+
+  template<class T>
+  void pack(T &pack) {
+    for (auto &value : values) {
+      pack(value);
+    }
+  }
+};
+
+TEST_CASE("Objects with many field names are packed as maps") {
+  auto object = NamedWide{};
+  for (auto i = 0; i < 100; ++i) {
+    object.values[std::size_t(i)] = i * 3 - 50;
+  }
+  std::error_code ec{};
+  auto unpacked = msgpack::unpack<NamedWide>(msgpack::pack(object), ec);
+  REQUIRE(!ec);
+  REQUIRE(unpacked.values == object.values);
+}
@@ -0,0 +1,40 @@
+#include <catch2/catch.hpp>
+
+#include <msgpack/parallel.hpp>
+
+struct ParallelExample {
+  uint64_t id;
+  std::string name;
+  std::vector<double> values;
+
+  template<class T>
+  void pack(T &pack) {
+    pack(id, name, values);
+  }
+};
+
+TEST_CASE("Parallel packing matches serial packing byte for byte") {
+  auto examples = std::vector<ParallelExample>{};
+  for (auto i = 0u; i < 10007; ++i) {
+    examples.push_back({uint64_t(i) * 1000003, std::string(i % 40, 'p'), std::vector<double>(i % 7, i * 0.5)});
+  }
+  auto serial = std::vector<uint8_t>{};
+  auto serial_offsets = msgpack::pack_many(examples, serial);
+
+  for (auto threads : {1u, 2u, 3u, 8u}) {
+    auto parallel = std::vector<uint8_t>{};
+    auto parallel_offsets = msgpack::pack_parallel(examples, parallel, threads);
+    REQUIRE(parallel == serial);
+    REQUIRE(parallel_offsets == serial_offsets);
+  }
+
+  auto appended = std::vector<uint8_t>{0xc0};
+  auto offsets = msgpack::pack_parallel(examples, appended, 4);
+  REQUIRE(offsets.front() == 1);
+  REQUIRE(std::equal(serial.begin(), serial.end(), appended.begin() + 1));
+
+  auto decoded = std::vector<ParallelExample>{};
+  REQUIRE(!msgpack::unpack_many(appended.data() + 1, appended.size() - 1, decoded));
+  REQUIRE(decoded.size() == examples.size());
+  REQUIRE(decoded.back().name == examples.back().name);
+}
@@ -0,0 +1,164 @@
+#include <catch2/catch.hpp>
+
+#include <iterator>
+#include <sstream>
+#include <cstdio>
+
+#include <msgpack/msgpack.hpp>
+#include <msgpack/posix_io.hpp>
+
+struct SinkExample {
+  std::string name;
+  uint16_t age;
+  std::vector<std::string> aliases;
+
+  template<class T>
+  void pack(T &pack) {
+    pack(name, age, aliases);
+  }
+};
+
+TEST_CASE("Packing into a caller owned vector appends") {
+  auto example = SinkExample{"John", 22, {"Ripper", "Silverhand"}};
+  auto expected = msgpack::pack(example);
+
+  auto buffer = std::vector<uint8_t>{0xff};
+  msgpack::pack(example, buffer);
+  REQUIRE(buffer.size() == expected.size() + 1);
+  REQUIRE(std::equal(expected.begin(), expected.end(), buffer.begin() + 1));
+
+  buffer.clear();
+  auto capacity = buffer.capacity();
+  msgpack::pack(example, buffer);
+  REQUIRE(buffer == expected);
+  REQUIRE(buffer.capacity() == capacity);
+}
+
+TEST_CASE("Packing into a fixed buffer") {
+  auto example = SinkExample{"John", 22, {"Ripper", "Silverhand"}};
+  auto expected = msgpack::pack(example);
+
+  auto buffer = std::array<uint8_t, 64>{};
+  std::error_code ec{};
+  auto size = msgpack::pack(example, buffer.data(), buffer.size(), ec);
+  REQUIRE(!ec);
+  REQUIRE(size == expected.size());
+  REQUIRE(std::equal(expected.begin(), expected.end(), buffer.begin()));
+
+  size = msgpack::pack(example, buffer.data(), expected.size() - 1, ec);
+  REQUIRE(ec == msgpack::PackerError::BufferOverflow);
+  REQUIRE(size < expected.size());
+}
+
+TEST_CASE("Packing through an output iterator") {
+  auto example = SinkExample{"John", 22, {"Ripper", "Silverhand"}};
+  auto expected = msgpack::pack(example);
+
+  auto buffer = std::vector<uint8_t>{};
+  msgpack::pack(example, std::back_inserter(buffer));
+  REQUIRE(buffer == expected);
+}
+
+TEST_CASE("Packer reuses a caller owned vector") {
+  auto buffer = std::vector<uint8_t>{};
+  auto packer = msgpack::BasicPacker<msgpack::VectorRefSink>{msgpack::VectorRefSink{buffer}};
+  packer.process(uint8_t(1), std::string("test"));
+  REQUIRE(buffer == std::vector<uint8_t>{1, 0b10100000 | 4, 't', 'e', 's', 't'});
+  REQUIRE(&packer.vector() == &buffer);
+}
+
+TEST_CASE("Pooled packing reuses buffers on the same thread") {
+  auto example = SinkExample{"John", 22, {"Ripper", "Silverhand"}};
+  auto expected = msgpack::pack(example);
+
+  auto pool = msgpack::BufferPool::local();
+  REQUIRE(pool != nullptr);
+  const uint8_t *first_data = nullptr;
+  {
+    auto packed = msgpack::pack_pooled(example);
+    REQUIRE(packed.vector() == expected);
+    REQUIRE(std::equal(packed.begin(), packed.end(), expected.begin(), expected.end()));
+    first_data = packed.data();
+  }
+  REQUIRE(pool->size() >= 1);
+  auto pooled = pool->size();
+  {
+    auto packed = msgpack::pack_pooled(example);
+    REQUIRE(pool->size() == pooled - 1);
+    REQUIRE(packed.data() == first_data);
+    auto moved = std::move(packed);
+    REQUIRE(moved[0] == expected[0]);
+    REQUIRE(packed.size() == 0);
+  }
+  REQUIRE(pool->size() == pooled);
+
+  auto kept = msgpack::pack_pooled(example).release();
+  REQUIRE(kept == expected);
+  REQUIRE(pool->size() == pooled - 1);
+
+  auto many = std::vector<msgpack::PooledBuffer>{};
+  for (auto i = std::size_t{0}; i < 2 * msgpack::BufferPool::max_buffers; ++i) {
+    many.push_back(msgpack::pack_pooled(example));
+  }
+  many.clear();
+  REQUIRE(pool->size() == msgpack::BufferPool::max_buffers);
+}
+
+TEST_CASE("Packing into an ostream") {
+  auto example = SinkExample{"John", 22, {"Ripper", "Silverhand"}};
+  auto expected = msgpack::pack(example);
+
+  auto stream = std::ostringstream{};
+  REQUIRE(!msgpack::pack(example, stream));
+  auto written = stream.str();
+  REQUIRE(std::equal(expected.begin(), expected.end(), written.begin(), written.end(),
+                     [](uint8_t a, char b) { return a == uint8_t(b); }));
+
+  stream.setstate(std::ios::badbit);
+  REQUIRE(msgpack::pack(example, stream) == msgpack::PackerError::WriteFailed);
+}
+
+TEST_CASE("Buffered sink flushes through a fixed size buffer") {
+  auto examples = std::vector<SinkExample>{};
+  for (auto i = 0; i < 200; ++i) {
+    examples.push_back({std::string(std::size_t(i), 'x'), uint16_t(i), {"a", std::string(100, 'b')}});
+  }
+  auto expected = std::vector<uint8_t>{};
+  for (auto &example : examples) {
+    msgpack::pack(example, expected);
+  }
+
+  auto stream = std::ostringstream{};
+  auto packer = msgpack::BasicPacker<msgpack::OstreamSink>{msgpack::OstreamSink{stream, 64}};
+  for (auto &example : examples) {
+    example.pack(packer);
+    REQUIRE(packer.sink().buffered() <= 64);
+  }
+  REQUIRE(packer.sink().flush());
+  REQUIRE(!packer.ec);
+  auto written = stream.str();
+  REQUIRE(std::equal(expected.begin(), expected.end(), written.begin(), written.end(),
+                     [](uint8_t a, char b) { return a == uint8_t(b); }));
+}
+
+TEST_CASE("Packing into a file descriptor") {
+  auto example = SinkExample{"John", 22, {std::string(100000, 'r'), "Silverhand"}};
+  auto expected = msgpack::pack(example);
+
+  auto file = std::tmpfile();
+  REQUIRE(file != nullptr);
+  auto fd = fileno(file);
+  REQUIRE(!msgpack::pack_to_fd(example, fd));
+  REQUIRE(lseek(fd, 0, SEEK_SET) == 0);
+  auto written = std::vector<uint8_t>(expected.size() + 1);
+  auto size = std::size_t{0};
+  while (auto count = read(fd, written.data() + size, written.size() - size)) {
+    REQUIRE(count > 0);
+    size += std::size_t(count);
+  }
+  written.resize(size);
+  REQUIRE(written == expected);
+  std::fclose(file);
+
+  REQUIRE(msgpack::pack_to_fd(example, -1) == std::errc::bad_file_descriptor);
+}
@@ -0,0 +1,240 @@
+#include <catch2/catch.hpp>
+
+#include <cstdlib>
+#include <unistd.h>
+
+#include <msgpack/msgpack.hpp>
+#include <msgpack/posix_io.hpp>
+
+struct StreamInner {
+  std::string label;
+  std::map<std::string, double> weights;
+
+  template<class T>
+  void pack(T &pack) {
+    pack(label, weights);
+  }
+};
+
+struct StreamExample {
+  std::string name;
+  int64_t id;
+  std::vector<uint8_t> blob;
+  StreamInner inner;
+  std::vector<StreamInner> history;
+
+  template<class T>
+  void pack(T &pack) {
+    pack(name, id, blob, inner, history);
+  }
+};
+
+// StreamExample with a number where its nested object belongs
+struct MismatchedExample {
+  std::string name;
+  int64_t id;
+  std::vector<uint8_t> blob;
+  int inner;
+  std::vector<StreamInner> history;
+
+  template<class T>
+  void pack(T &pack) {
+    pack(name, id, blob, inner, history);
+  }
+};
+
+static std::vector<StreamExample> stream_examples() {
+  auto examples = std::vector<StreamExample>{};
+  examples.push_back({"first", 1, {1, 2, 3}, {"a", {{"x", 1.5}}}, {}});
+  examples.push_back({std::string(300, 'n'), -70000, std::vector<uint8_t>(70000, 0x5a),
+                      {"b", {{"y", -2.0}, {"z", 0.25}}}, {{"c", {}}, {"d", {{"w", 3.0}}}}});
+  examples.push_back({"", 0, {}, {}, {}});
+  return examples;
+}
+
+TEST_CASE("Stream unpacker returns each message as soon as its last byte arrives") {
+  auto examples = stream_examples();
+  auto ends = std::vector<std::size_t>{};
+  auto stream = std::vector<uint8_t>{};
+  for (auto &example : examples) {
+    msgpack::pack(example, stream);
+    ends.push_back(stream.size());
+  }
+
+  auto unpacker = msgpack::StreamUnpacker<StreamExample>{};
+  auto decoded = std::size_t{0};
+  for (auto i = std::size_t{0}; i < stream.size(); ++i) {
+    unpacker.feed(&stream[i], 1);
+    auto obj = StreamExample{};
+    if (unpacker.next(obj)) {
+      REQUIRE(i + 1 == ends[decoded]);
+      REQUIRE(obj.name == examples[decoded].name);
+      REQUIRE(obj.id == examples[decoded].id);
+      REQUIRE(obj.blob == examples[decoded].blob);
+      REQUIRE(obj.inner.weights == examples[decoded].inner.weights);
+      REQUIRE(obj.history.size() == examples[decoded].history.size());
+      ++decoded;
+    }
+    REQUIRE(!unpacker.ec);
+    REQUIRE(unpacker.buffered() <= i + 1 - (decoded > 0 ? ends[decoded - 1] : 0));
+  }
+  REQUIRE(decoded == examples.size());
+  REQUIRE(unpacker.buffered() == 0);
+}
+
+TEST_CASE("Stream unpacker handles several messages in one chunk") {
+  auto examples = stream_examples();
+  auto stream = std::vector<uint8_t>{};
+  for (auto &example : examples) {
+    msgpack::pack(example, stream);
+  }
+
+  auto unpacker = msgpack::StreamUnpacker<StreamExample>{};
+  unpacker.feed(stream.data(), stream.size() - 1);
+  auto obj = StreamExample{};
+  REQUIRE(unpacker.next(obj));
+  REQUIRE(obj.id == examples[0].id);
+  REQUIRE(unpacker.next(obj));
+  REQUIRE(obj.id == examples[1].id);
+  REQUIRE(!unpacker.next(obj));
+  REQUIRE(unpacker.buffered() == stream.size() - 1 - msgpack::pack(examples[0]).size() - msgpack::pack(examples[1]).size());
+
+  unpacker.feed(&stream.back(), 1);
+  REQUIRE(unpacker.next(obj));
+  REQUIRE(obj.name.empty());
+  REQUIRE(unpacker.buffered() == 0);
+  REQUIRE(!unpacker.ec);
+}
+
+TEST_CASE("Stream unpacker rejects invalid format bytes") {
+  auto unpacker = msgpack::StreamUnpacker<StreamExample>{};
+  auto stream = std::vector<uint8_t>{0xa1, 'a', 0xc1};
+  unpacker.feed(stream);
+  auto obj = StreamExample{};
+  REQUIRE(!unpacker.next(obj));
+  REQUIRE(unpacker.ec == msgpack::UnpackerError::InvalidFormat);
+}
+
+TEST_CASE("Unpack reports the bytes it consumed") {
+  auto examples = stream_examples();
+  auto stream = std::vector<uint8_t>{};
+  msgpack::pack(examples[0], stream);
+  auto first_size = stream.size();
+  msgpack::pack(examples[1], stream);
+
+  std::error_code ec{};
+  auto consumed = std::size_t{0};
+  auto obj = msgpack::unpack<StreamExample>(stream.data(), stream.size(), ec, consumed);
+  REQUIRE(!ec);
+  REQUIRE(consumed == first_size);
+  REQUIRE(obj.name == examples[0].name);
+}
+
+TEST_CASE("Record reader walks back to back messages") {
+  auto examples = stream_examples();
+  auto stream = std::vector<uint8_t>{};
+  auto ends = std::vector<std::size_t>{};
+  for (auto &example : examples) {
+    msgpack::pack(example, stream);
+    ends.push_back(stream.size());
+  }
+
+  auto reader = msgpack::RecordReader<StreamExample>{stream.data(), stream.size()};
+  auto obj = StreamExample{};
+  for (auto i = std::size_t{0}; i < examples.size(); ++i) {
+    REQUIRE(reader.next(obj));
+    REQUIRE(obj.id == examples[i].id);
+    REQUIRE(reader.offset() == ends[i]);
+  }
+  REQUIRE(reader.done());
+  REQUIRE(!reader.next(obj));
+  REQUIRE(!reader.ec);
+
+  reader.seek(0);
+  auto raw = msgpack::bin_view{};
+  for (auto i = std::size_t{0}; i < examples.size(); ++i) {
+    REQUIRE(reader.next(raw));
+    REQUIRE(raw.data() == stream.data() + (i == 0 ? 0 : ends[i - 1]));
+    REQUIRE(reader.offset() == ends[i]);
+    REQUIRE(msgpack::unpack<StreamExample>(raw.data(), raw.size()).name == examples[i].name);
+  }
+  REQUIRE(reader.done());
+
+  reader = msgpack::RecordReader<StreamExample>{stream.data(), stream.size() - 1};
+  reader.seek(ends[1]);
+  REQUIRE(!reader.next(raw));
+  REQUIRE(reader.ec == msgpack::UnpackerError::OutOfRange);
+}
+
+TEST_CASE("Record reader over a mapped file") {
+  auto examples = stream_examples();
+  char path[] = "/tmp/cppack_records_XXXXXX";
+  auto fd = mkstemp(path);
+  REQUIRE(fd >= 0);
+  for (auto i = 0; i < 10; ++i) {
+    for (auto &example : examples) {
+      REQUIRE(!msgpack::pack_to_fd(example, fd));
+    }
+  }
+  close(fd);
+
+  std::error_code ec{};
+  auto file = msgpack::MappedFile{path, ec};
+  unlink(path);
+  REQUIRE(!ec);
+  REQUIRE(file.size() > 700000);
+
+  auto reader = file.records<StreamExample>();
+  auto obj = StreamExample{};
+  auto count = std::size_t{0};
+  while (reader.next(obj)) {
+    REQUIRE(obj.id == examples[count % examples.size()].id);
+    file.release(reader.offset());
+    ++count;
+  }
+  REQUIRE(!reader.ec);
+  REQUIRE(count == 10 * examples.size());
+  REQUIRE(reader.offset() == file.size());
+  REQUIRE(file.advise(MADV_RANDOM));
+
+  auto missing = msgpack::MappedFile{"/nonexistent/cppack", ec};
+  REQUIRE(ec == std::errc::no_such_file_or_directory);
+  REQUIRE(missing.data() == nullptr);
+}
+
+TEST_CASE("Packing and unpacking a batch") {
+  auto examples = stream_examples();
+  auto buffer = std::vector<uint8_t>{0xc0};
+  auto offsets = msgpack::pack_many(examples, buffer);
+  REQUIRE(offsets.size() == examples.size());
+  REQUIRE(offsets[0] == 1);
+  for (auto i = std::size_t{0}; i < examples.size(); ++i) {
+    auto expected = msgpack::pack(examples[i]);
+    REQUIRE(std::equal(expected.begin(), expected.end(), buffer.begin() + std::ptrdiff_t(offsets[i])));
+  }
+
+  buffer.erase(buffer.begin());
+  auto decoded = std::vector<StreamExample>(1);
+  REQUIRE(!msgpack::unpack_many(buffer, decoded));
+  REQUIRE(decoded.size() == examples.size() + 1);
+  for (auto i = std::size_t{0}; i < examples.size(); ++i) {
+    REQUIRE(decoded[i + 1].name == examples[i].name);
+    REQUIRE(decoded[i + 1].blob == examples[i].blob);
+  }
+
+  buffer.pop_back();
+  std::error_code ec{};
+  decoded = msgpack::unpack_many<StreamExample>(buffer, ec);
+  REQUIRE(ec == msgpack::UnpackerError::OutOfRange);
+  REQUIRE(decoded.size() == examples.size() - 1);
+
+  // Well formed, so the records are all counted, but the second one doesn't decode as a StreamExample
+  auto mismatched = std::vector<uint8_t>{};
+  msgpack::pack(examples[0], mismatched);
+  msgpack::pack(MismatchedExample{"second", 2, {}, 3, {}}, mismatched);
+  msgpack::pack(examples[2], mismatched);
+  decoded = msgpack::unpack_many<StreamExample>(mismatched, ec);
+  REQUIRE(ec == msgpack::UnpackerError::InvalidFormat);
+  REQUIRE(decoded.size() == 1);
+  REQUIRE(decoded[0].name == examples[0].name);
+}
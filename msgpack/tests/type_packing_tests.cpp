@@ -4,6 +4,8 @@
 
 #include <catch2/catch.hpp>
 
+#include <cstring>
+
 #include <msgpack/msgpack.hpp>
 
 TEST_CASE("Nil type packing") {
@@ -134,6 +136,120 @@ TEST_CASE("Chrono type packing") {
   REQUIRE(test_time_point == test_time_point_copy);
 }
 
+TEST_CASE("Time points pack as the smallest timestamp extension") {
+  using Nanoseconds = std::chrono::time_point<std::chrono::system_clock, std::chrono::nanoseconds>;
+  auto pack_time = [](Nanoseconds time) {
+    auto packer = msgpack::Packer{};
+    packer.process(time);
+    return packer.vector();
+  };
+  auto unpack_time = [](const std::vector<uint8_t> &data, std::error_code &ec) {
+    auto unpacker = msgpack::Unpacker{data.data(), data.size()};
+    auto time = Nanoseconds{};
+    unpacker.process(time);
+    ec = unpacker.ec;
+    return time;
+  };
+
+  auto seconds_only = Nanoseconds{std::chrono::seconds(0x12345678)};
+  REQUIRE(pack_time(seconds_only) == std::vector<uint8_t>{0xd6, 0xff, 0x12, 0x34, 0x56, 0x78});
+
+  auto with_nanoseconds = Nanoseconds{std::chrono::seconds(1) + std::chrono::nanoseconds(1)};
+  REQUIRE(pack_time(with_nanoseconds) == std::vector<uint8_t>{0xd7, 0xff, 0, 0, 0, 0x04, 0, 0, 0, 0x01});
+
+  auto before_epoch = Nanoseconds{std::chrono::nanoseconds(-1)};
+  REQUIRE(pack_time(before_epoch)
+              == std::vector<uint8_t>{0xc7, 12, 0xff, 0x3b, 0x9a, 0xc9, 0xff,
+                                      0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff});
+
+  auto extremes = {Nanoseconds{}, seconds_only, with_nanoseconds, before_epoch,
+                   Nanoseconds{std::chrono::nanoseconds(std::numeric_limits<int64_t>::max())},
+                   Nanoseconds{std::chrono::nanoseconds(std::numeric_limits<int64_t>::min() + 1)},
+                   Nanoseconds{std::chrono::seconds(0x200000000) + std::chrono::nanoseconds(999999999)}};
+  for (auto time : extremes) {
+    std::error_code ec{};
+    REQUIRE(unpack_time(pack_time(time), ec) == time);
+    REQUIRE(!ec);
+  }
+
+  std::error_code ec{};
+  auto legacy = msgpack::Packer{};
+  legacy.process(int64_t(1234567890123));
+  REQUIRE(unpack_time(legacy.vector(), ec) == Nanoseconds{std::chrono::nanoseconds(1234567890123)});
+  REQUIRE(!ec);
+
+  unpack_time({0xd6, 0x01, 0, 0, 0, 0}, ec);
+  REQUIRE(ec == msgpack::UnpackerError::ExtensionMismatch);
+  unpack_time({0xd7, 0xff, 0xff, 0xff, 0xff, 0xff, 0, 0, 0, 0}, ec); // More than 999999999 nanoseconds
+  REQUIRE(ec == msgpack::UnpackerError::ExtensionMismatch);
+  unpack_time({0xc7, 12, 0xff, 0, 0}, ec);
+  REQUIRE(ec == msgpack::UnpackerError::OutOfRange);
+
+  // Timestamps further out than the nanosecond clock reaches
+  unpack_time({0xc7, 12, 0xff, 0, 0, 0, 0, 0x7f, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff}, ec);
+  REQUIRE(ec == msgpack::UnpackerError::ExtensionMismatch);
+  unpack_time({0xc7, 12, 0xff, 0, 0, 0, 0, 0x80, 0, 0, 0, 0, 0, 0, 0}, ec);
+  REQUIRE(ec == msgpack::UnpackerError::ExtensionMismatch);
+  // 854775808 nanoseconds on top of the largest whole second, one more than fits
+  unpack_time({0xd7, 0xff, 0xcb, 0xcb, 0x60, 0x02, 0x25, 0xc1, 0x7d, 0x04}, ec);
+  REQUIRE(ec == msgpack::UnpackerError::ExtensionMismatch);
+
+  // Year 2514 is past the end of a nanosecond clock but fits a microsecond one
+  auto far_future = std::vector<uint8_t>{0xd7, 0xff, 0, 0, 0, 0x03, 0xff, 0xff, 0xff, 0xff};
+  auto unpacker = msgpack::Unpacker{far_future.data(), far_future.size()};
+  auto coarse = std::chrono::time_point<std::chrono::system_clock, std::chrono::microseconds>{};
+  unpacker.process(coarse);
+  REQUIRE(!unpacker.ec);
+  REQUIRE(coarse.time_since_epoch() == std::chrono::seconds(0x3ffffffff));
+  unpack_time(far_future, ec);
+  REQUIRE(ec == msgpack::UnpackerError::ExtensionMismatch);
+}
+
+struct ExampleUuid {
+  std::array<uint8_t, 16> bytes{};
+};
+
+template<>
+struct msgpack::ext_type<ExampleUuid> {
+  static constexpr int8_t id = 7;
+  static constexpr std::size_t max_size = 16;
+
+  static std::size_t pack(const ExampleUuid &value, uint8_t *out) {
+    std::copy(value.bytes.begin(), value.bytes.end(), out);
+    return value.bytes.size();
+  }
+
+  static bool unpack(const uint8_t *data, std::size_t size, ExampleUuid &value) {
+    if (size != value.bytes.size()) {
+      return false;
+    }
+    std::copy(data, data + size, value.bytes.begin());
+    return true;
+  }
+};
+
+TEST_CASE("User types can be registered as extensions") {
+  auto ids = std::vector<ExampleUuid>(2);
+  ids[1].bytes.fill(0xab);
+  auto packer = msgpack::Packer{};
+  packer.process(ids);
+  REQUIRE(packer.vector().size() == 1 + 2 * 18);
+  REQUIRE(packer.vector()[1] == 0xd8);
+  REQUIRE(packer.vector()[2] == 7);
+
+  auto unpacker = msgpack::Unpacker{packer.vector().data(), packer.vector().size()};
+  auto unpacked = std::vector<ExampleUuid>{};
+  unpacker.process(unpacked);
+  REQUIRE(!unpacker.ec);
+  REQUIRE(unpacked.size() == 2);
+  REQUIRE(unpacked[1].bytes == ids[1].bytes);
+
+  auto data = std::vector<uint8_t>{0xd6, 7, 1, 2, 3, 4};
+  unpacker.set_data(data.data(), data.size());
+  unpacker.process(unpacked[0]);
+  REQUIRE(unpacker.ec == msgpack::UnpackerError::ExtensionMismatch);
+}
+
 TEST_CASE("Float type packing") {
   auto packer = msgpack::Packer{};
   auto unpacker = msgpack::Unpacker{};
@@ -241,4 +357,344 @@ TEST_CASE("Unordered map packing") {
   unpacker.process(map1);
   REQUIRE(map1[0] == map_copy[0]);
   REQUIRE(map1[1] == map_copy[1]);
-}
\ No newline at end of file
+}
+
+TEST_CASE("Integer boundary packing") {
+  auto packer = msgpack::Packer{};
+  auto unpacker = msgpack::Unpacker{};
+
+  auto small = int16_t(-1);
+  auto min32 = std::numeric_limits<int32_t>::min();
+  auto min64 = std::numeric_limits<int64_t>::min();
+  auto max64 = std::numeric_limits<uint64_t>::max();
+  auto mid64 = uint64_t(70000);
+  auto trailing = uint8_t(42);
+  packer.process(small, min32, min64, max64, mid64, trailing);
+  REQUIRE(packer.vector() == std::vector<uint8_t>{0xff,
+                                                  0xd2, 0x80, 0x00, 0x00, 0x00,
+                                                  0xd3, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+                                                  0xcf, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+                                                  0xce, 0x00, 0x01, 0x11, 0x70,
+                                                  42});
+
+  small = 0;
+  min32 = 0;
+  min64 = 0;
+  max64 = 0;
+  mid64 = 0;
+  trailing = 0;
+  unpacker.set_data(packer.vector().data(), packer.vector().size());
+  unpacker.process(small, min32, min64, max64, mid64, trailing);
+  REQUIRE(!unpacker.ec);
+  REQUIRE(small == -1);
+  REQUIRE(min32 == std::numeric_limits<int32_t>::min());
+  REQUIRE(min64 == std::numeric_limits<int64_t>::min());
+  REQUIRE(max64 == std::numeric_limits<uint64_t>::max());
+  REQUIRE(mid64 == 70000);
+  REQUIRE(trailing == 42);
+}
+
+TEST_CASE("Truncated multi-byte values fail safely") {
+  auto unpacker = msgpack::Unpacker{};
+  auto data = std::vector<uint8_t>{0xce, 0x00, 0x01};
+  auto value = uint32_t(0);
+  unpacker.set_data(data.data(), data.size());
+  unpacker.process(value);
+  REQUIRE(unpacker.ec == msgpack::UnpackerError::OutOfRange);
+}
+
+TEST_CASE("Special float values packing") {
+  auto packer = msgpack::Packer{};
+  auto unpacker = msgpack::Unpacker{};
+
+  auto floats = std::vector<float>{std::numeric_limits<float>::quiet_NaN(), std::numeric_limits<float>::infinity(),
+                                   -std::numeric_limits<float>::infinity(), -0.0f,
+                                   std::numeric_limits<float>::denorm_min(), std::numeric_limits<float>::max(),
+                                   std::numeric_limits<float>::lowest(), 1e30f};
+  for (auto test_num : floats) {
+    packer.clear();
+    packer.process(test_num);
+    float x = 0.0f;
+    unpacker.set_data(packer.vector().data(), packer.vector().size());
+    unpacker.process(x);
+    REQUIRE(std::memcmp(&x, &test_num, sizeof(float)) == 0);
+  }
+
+  auto doubles = std::vector<double>{std::numeric_limits<double>::quiet_NaN(), std::numeric_limits<double>::infinity(),
+                                     -std::numeric_limits<double>::infinity(), -0.0,
+                                     std::numeric_limits<double>::denorm_min(), std::numeric_limits<double>::max(),
+                                     std::numeric_limits<double>::lowest(), 9223372036854775808.0};
+  for (auto test_num : doubles) {
+    packer.clear();
+    packer.process(test_num);
+    double x = 0.0;
+    unpacker.set_data(packer.vector().data(), packer.vector().size());
+    unpacker.process(x);
+    REQUIRE(std::memcmp(&x, &test_num, sizeof(double)) == 0);
+  }
+}
+
+TEST_CASE("Integral floats packing") {
+  auto packer = msgpack::Packer{};
+  packer.process(2.0f, -3.0);
+  REQUIRE(packer.vector() == std::vector<uint8_t>{0x02, 0xfd});
+
+  packer = msgpack::Packer{msgpack::PackerOptions{false, true}};
+  packer.process(2.0f, -3.0);
+  REQUIRE(packer.vector() == std::vector<uint8_t>{0xca, 0x40, 0x00, 0x00, 0x00,
+                                                  0xcb, 0xc0, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00});
+
+  auto unpacker = msgpack::Unpacker{packer.vector().data(), packer.vector().size()};
+  auto as_double = 0.0;
+  auto as_float = 0.0f;
+  unpacker.process(as_double, as_float);
+  REQUIRE(as_double == 2.0);
+  REQUIRE(as_float == -3.0f);
+}
+
+TEST_CASE("Number array packing") {
+  auto ints = std::vector<int32_t>{};
+  auto doubles = std::vector<double>{};
+  for (auto i = -300; i < 300; ++i) {
+    ints.emplace_back(i * i * i);
+    ints.emplace_back(i % 40);
+    doubles.emplace_back(double(i) / 8);
+  }
+  auto shorts = std::array<int16_t, 40>{};
+  auto bytes = std::vector<int8_t>{};
+  auto longs = std::vector<uint64_t>{};
+  for (auto i = 0U; i < shorts.size(); ++i) {
+    shorts[i] = int16_t(i * 1000);
+    bytes.emplace_back(int8_t(i * 7));
+    longs.emplace_back(uint64_t(i) << (i % 64));
+  }
+
+  for (auto fixed_width : {false, true}) {
+    auto options = msgpack::PackerOptions{};
+    options.fixed_width_arrays = fixed_width;
+    auto packer = msgpack::Packer{options};
+    packer.process(ints, doubles, shorts, bytes, longs);
+
+    auto unpacked_ints = std::vector<int32_t>{};
+    auto unpacked_doubles = std::vector<double>{};
+    auto unpacked_shorts = std::array<int16_t, 40>{};
+    auto unpacked_bytes = std::vector<int8_t>{};
+    auto unpacked_longs = std::vector<uint64_t>{};
+    auto unpacker = msgpack::Unpacker{packer.vector().data(), packer.vector().size()};
+    unpacker.process(unpacked_ints, unpacked_doubles, unpacked_shorts, unpacked_bytes, unpacked_longs);
+    REQUIRE(!unpacker.ec);
+    REQUIRE(unpacked_ints == ints);
+    REQUIRE(unpacked_doubles == doubles);
+    REQUIRE(unpacked_shorts == shorts);
+    REQUIRE(unpacked_bytes == bytes);
+    REQUIRE(unpacked_longs == longs);
+  }
+}
+
+TEST_CASE("Fixed width number array packing") {
+  auto options = msgpack::PackerOptions{};
+  options.fixed_width_arrays = true;
+  auto packer = msgpack::Packer{options};
+  packer.process(std::vector<int32_t>{1, -2}, std::array<float, 1>{1.0f});
+  REQUIRE(packer.vector() == std::vector<uint8_t>{0b10010000 | 2, 0xd2, 0x00, 0x00, 0x00, 0x01,
+                                                  0xd2, 0xff, 0xff, 0xff, 0xfe,
+                                                  0b10010000 | 1, 0xca, 0x3f, 0x80, 0x00, 0x00});
+}
+
+TEST_CASE("Number array with a forged size fails safely") {
+  auto data = std::vector<uint8_t>{0xdd, 0xff, 0xff, 0xff, 0xff, 0x01, 0x02};
+  auto values = std::vector<uint64_t>{};
+  auto unpacker = msgpack::Unpacker{data.data(), data.size()};
+  unpacker.process(values);
+  REQUIRE(unpacker.ec == msgpack::UnpackerError::OutOfRange);
+  REQUIRE(values == std::vector<uint64_t>{1, 2});
+}
+
+TEST_CASE("Negative integral floats packing") {
+  auto packer = msgpack::Packer{};
+  packer.process(-1.0f, -20.0, -1000.0f);
+  auto unpacker = msgpack::Unpacker{packer.vector().data(), packer.vector().size()};
+  auto small_float = 0.0f;
+  auto small_double = 0.0;
+  auto large_float = 0.0f;
+  unpacker.process(small_float, small_double, large_float);
+  REQUIRE(small_float == -1.0f);
+  REQUIRE(small_double == -20.0);
+  REQUIRE(large_float == -1000.0f);
+}
+
+TEST_CASE("Container unpacking reserves once") {
+  auto strings = std::vector<std::string>{};
+  auto map = std::unordered_map<uint32_t, std::string>{};
+  for (auto i = 0U; i < 100; ++i) {
+    strings.emplace_back(std::string(40, char('a' + i % 26)));
+    map[i] = strings.back();
+  }
+  auto packer = msgpack::Packer{};
+  packer.process(strings, map);
+
+  auto unpacked_strings = std::vector<std::string>{};
+  auto unpacked_map = std::unordered_map<uint32_t, std::string>{};
+  auto unpacker = msgpack::Unpacker{packer.vector().data(), packer.vector().size()};
+  unpacker.process(unpacked_strings, unpacked_map);
+  REQUIRE(!unpacker.ec);
+  REQUIRE(unpacked_strings == strings);
+  REQUIRE(unpacked_strings.capacity() == strings.size());
+  REQUIRE(unpacked_map == map);
+}
+
+TEST_CASE("Set type packing") {
+  auto packer = msgpack::Packer{};
+  auto set = std::set<std::string>{"one", "two", "three"};
+  packer.process(set);
+  auto unpacked_set = std::set<std::string>{};
+  auto unpacker = msgpack::Unpacker{packer.vector().data(), packer.vector().size()};
+  unpacker.process(unpacked_set);
+  REQUIRE(unpacked_set == set);
+}
+
+TEST_CASE("Containers with custom comparators and allocators") {
+  auto packer = msgpack::Packer{};
+  auto descending = std::map<std::string, int32_t, std::greater<>>{{"a", 1}, {"b", 2}};
+  auto ids = std::unordered_set<uint64_t>{1, 2, 3};
+  auto bytes = std::pmr::vector<uint8_t>{1, 2, 3};
+  packer.process(descending, ids, bytes);
+  REQUIRE(packer.vector()[0] == 0x82);
+  REQUIRE(packer.vector()[1] == 0xa1);
+  REQUIRE(packer.vector()[2] == 'b');
+  REQUIRE(packer.vector()[packer.vector().size() - 5] == msgpack::bin8);
+
+  auto unpacked_descending = std::map<std::string, int32_t, std::greater<>>{};
+  auto unpacked_ids = std::unordered_set<uint64_t>{};
+  auto unpacked_bytes = std::pmr::vector<uint8_t>{};
+  auto unpacker = msgpack::Unpacker{packer.vector().data(), packer.vector().size()};
+  unpacker.process(unpacked_descending, unpacked_ids, unpacked_bytes);
+  REQUIRE(!unpacker.ec);
+  REQUIRE(unpacked_descending == descending);
+  REQUIRE(unpacked_ids == ids);
+  REQUIRE(unpacked_bytes == bytes);
+}
+
+struct PmrMessage {
+  using allocator_type = std::pmr::polymorphic_allocator<std::byte>;
+
+  std::pmr::string name;
+  std::pmr::vector<std::pmr::string> tags;
+  std::pmr::map<std::pmr::string, std::pmr::vector<int32_t>> series;
+
+  explicit PmrMessage(const allocator_type &allocator = {})
+      : name(allocator), tags(allocator), series(allocator) {};
+
+  template<class T>
+  void pack(T &pack) {
+    pack(name, tags, series);
+  }
+};
+
+TEST_CASE("Polymorphic allocator types decode into a memory resource") {
+  auto message = PmrMessage{};
+  message.name = std::pmr::string(100, 'n');
+  message.tags = {std::pmr::string(50, 'a'), std::pmr::string(60, 'b')};
+  message.series[std::pmr::string(40, 'k')] = {1, 2, 3};
+  auto data = msgpack::pack(message);
+
+  // Any allocation that misses the arena throws
+  auto previous = std::pmr::set_default_resource(std::pmr::null_memory_resource());
+  alignas(std::max_align_t) std::array<std::byte, 4096> arena{};
+  std::pmr::monotonic_buffer_resource resource{arena.data(), arena.size(), std::pmr::null_memory_resource()};
+  std::error_code ec{};
+  auto unpacked = msgpack::unpack<PmrMessage>(data, &resource, ec);
+  std::pmr::set_default_resource(previous);
+
+  REQUIRE(!ec);
+  REQUIRE(unpacked.name == message.name);
+  REQUIRE(unpacked.tags == message.tags);
+  REQUIRE(unpacked.series == message.series);
+  REQUIRE(unpacked.tags[1].get_allocator().resource() == &resource);
+  REQUIRE(unpacked.series.begin()->second.get_allocator().resource() == &resource);
+
+  auto loose = std::vector<std::pmr::string>{};
+  auto unpacker = msgpack::Unpacker{data.data(), data.size()};
+  unpacker.memory_resource = &resource;
+  auto name = std::pmr::string{&resource};
+  unpacker.process(name, loose);
+  REQUIRE(!unpacker.ec);
+  REQUIRE(loose[0].get_allocator().resource() == &resource);
+}
+
+TEST_CASE("Containers with forged sizes fail safely") {
+  auto data = std::vector<uint8_t>{0xdd, 0xff, 0xff, 0xff, 0xff, 0xa1, 'a'};
+  auto strings = std::vector<std::string>{};
+  auto unpacker = msgpack::Unpacker{data.data(), data.size()};
+  unpacker.process(strings);
+  REQUIRE(unpacker.ec == msgpack::UnpackerError::OutOfRange);
+  REQUIRE(strings.capacity() <= data.size());
+
+  data = std::vector<uint8_t>{0xdf, 0xff, 0xff, 0xff, 0xff, 0x01, 0xa1, 'a'};
+  auto map = std::unordered_map<uint8_t, std::string>{};
+  unpacker.set_data(data.data(), data.size());
+  unpacker.ec.clear();
+  unpacker.process(map);
+  REQUIRE(unpacker.ec == msgpack::UnpackerError::OutOfRange);
+  REQUIRE(map.size() == 1);
+}
+
+struct FixedInner {
+  float x{};
+  std::array<int16_t, 3> y{};
+
+  template<class T>
+  constexpr void pack(T &pack) {
+    pack(x, y);
+  }
+};
+
+struct FixedOuter {
+  uint64_t id{};
+  bool flag{};
+  std::array<FixedInner, 2> inner{};
+  double value{};
+  std::chrono::time_point<std::chrono::system_clock, std::chrono::nanoseconds> time{};
+
+  template<class T>
+  constexpr void pack(T &pack) {
+    pack(id, flag, inner, value, time);
+  }
+};
+
+TEST_CASE("Fixed shape types have a compile time size bound") {
+  static_assert(msgpack::max_packed_size_v<FixedInner> == 9 + 1 + 3 * 3);
+  // 9 + 1 + (1 + 2 * (2 + 19)) + 9 + 15, nested objects reserve room for a bin8 header
+  static_assert(msgpack::max_packed_size_v<FixedOuter> == 77);
+
+  auto worst = FixedOuter{0xffffffffffffffff, true, {}, 0.1, {}};
+  worst.time += std::chrono::nanoseconds(-0x7fffffffffffffff);
+  for (auto &inner : worst.inner) {
+    inner = FixedInner{0.1f, {-32768, -32768, -32768}};
+  }
+  auto fixed = msgpack::pack_fixed(worst);
+  static_assert(std::tuple_size<decltype(fixed.bytes)>::value == 77);
+  auto expected = msgpack::pack(worst);
+  REQUIRE(!fixed.ec);
+  REQUIRE(fixed.size == expected.size());
+  REQUIRE(std::equal(expected.begin(), expected.end(), fixed.bytes.begin()));
+
+  auto legacy = msgpack::Packer{msgpack::PackerOptions{true}};
+  worst.pack(legacy);
+  REQUIRE(legacy.vector().size() <= msgpack::max_packed_size_v<FixedOuter>);
+
+  // Integral floats too large for an int32 are packed as int64, which is longer than the float itself
+  worst.value = 1e18;
+  for (auto &inner : worst.inner) {
+    inner.x = 3e9f;
+  }
+  fixed = msgpack::pack_fixed(worst);
+  expected = msgpack::pack(worst);
+  REQUIRE(!fixed.ec);
+  REQUIRE(fixed.size == expected.size());
+  REQUIRE(std::equal(expected.begin(), expected.end(), fixed.bytes.begin()));
+
+  auto small = msgpack::pack_fixed(FixedOuter{});
+  REQUIRE(small.size < 77);
+  REQUIRE(msgpack::unpack<FixedOuter>(small.bytes.data(), small.size).id == 0);
+}
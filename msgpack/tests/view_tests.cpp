@@ -0,0 +1,100 @@
+#include <catch2/catch.hpp>
+
+#include <cstdlib>
+#include <new>
+
+#include <msgpack/msgpack.hpp>
+
+namespace {
+std::size_t allocation_count = 0;
+}
+
+void *operator new(std::size_t size) {
+  ++allocation_count;
+  if (auto pointer = std::malloc(size)) {
+    return pointer;
+  }
+  throw std::bad_alloc{};
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept {
+  ++allocation_count;
+  return std::malloc(size);
+}
+
+void operator delete(void *pointer) noexcept {
+  std::free(pointer);
+}
+
+void operator delete(void *pointer, std::size_t /*size*/) noexcept {
+  std::free(pointer);
+}
+
+struct RoutedMessage {
+  std::string_view key;
+  uint32_t sequence{};
+  msgpack::bin_view payload;
+
+  template<class T>
+  void pack(T &pack) {
+    pack(key, sequence, payload);
+  }
+};
+
+TEST_CASE("Views unpack without allocating") {
+  auto payload = std::vector<uint8_t>(1000, 0xab);
+  auto message = RoutedMessage{"sensors/left/temperature", 70000, {payload.data(), payload.size()}};
+  auto data = msgpack::pack(message);
+
+  auto allocations_before = allocation_count;
+  std::error_code ec{};
+  auto unpacked = msgpack::unpack<RoutedMessage>(data, ec);
+  auto allocations = allocation_count - allocations_before;
+
+  REQUIRE(allocations == 0);
+  REQUIRE(!ec);
+  REQUIRE(unpacked.key == "sensors/left/temperature");
+  REQUIRE(unpacked.sequence == 70000);
+  REQUIRE(unpacked.payload.size() == payload.size());
+  REQUIRE(std::equal(payload.begin(), payload.end(), unpacked.payload.begin()));
+  REQUIRE(unpacked.key.data() >= reinterpret_cast<const char *>(data.data()));
+  REQUIRE(unpacked.payload.data() < data.data() + data.size());
+}
+
+TEST_CASE("Views pack like their owning types") {
+  auto owning = msgpack::Packer{};
+  owning.process(std::string("key"), std::vector<uint8_t>{1, 2, 3});
+  auto bytes = std::vector<uint8_t>{1, 2, 3};
+  auto viewing = msgpack::Packer{};
+  viewing.process(std::string_view("key"), msgpack::bin_view{bytes.data(), bytes.size()});
+  REQUIRE(owning.vector() == viewing.vector());
+}
+
+TEST_CASE("Truncated views fail safely") {
+  auto data = std::vector<uint8_t>{0xa5, 'a', 'b'};
+  auto view = std::string_view{};
+  auto unpacker = msgpack::Unpacker{data.data(), data.size()};
+  unpacker.process(view);
+  REQUIRE(unpacker.ec == msgpack::UnpackerError::OutOfRange);
+  REQUIRE(view.empty());
+}
+
+TEST_CASE("Batches of views unpack with a single allocation") {
+  auto payload = std::vector<uint8_t>(100, 0xab);
+  auto messages = std::vector<RoutedMessage>{};
+  for (auto i = 0u; i < 1000; ++i) {
+    messages.push_back({"sensors/left/temperature", i, {payload.data(), payload.size()}});
+  }
+  auto data = std::vector<uint8_t>{};
+  auto before = allocation_count;
+  msgpack::pack_many(messages, data);
+  REQUIRE(allocation_count - before == 2); // The offsets and data, both sized before anything is packed
+
+  auto decoded = std::vector<RoutedMessage>{};
+  before = allocation_count;
+  REQUIRE(!msgpack::unpack_many(data, decoded));
+  REQUIRE(allocation_count - before == 1);
+  REQUIRE(decoded.size() == messages.size());
+  REQUIRE(decoded.back().sequence == 999);
+  REQUIRE(decoded.back().payload.size() == 100);
+}